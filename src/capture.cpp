@@ -0,0 +1,178 @@
+#include "capture.hpp"
+#include <cstring>
+
+#ifndef GL_MAP_READ_BIT
+#define GL_MAP_READ_BIT 0x0001
+#endif
+#ifndef GL_DRAW_FRAMEBUFFER_BINDING
+#define GL_DRAW_FRAMEBUFFER_BINDING 0x8CA6
+#endif
+#ifndef GL_SAMPLE_BUFFERS
+#define GL_SAMPLE_BUFFERS 0x80A8
+#endif
+#ifndef GL_RGBA8
+#define GL_RGBA8 0x8058
+#endif
+
+CaptureBackend::~CaptureBackend() {
+    destroy();
+}
+
+bool CaptureBackend::setup(int w, int h) {
+    destroy();
+    m_w = w; m_h = h;
+    glGenBuffers(N_SLOTS, m_pbo);
+    for (int i = 0; i < N_SLOTS; i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbo[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)w * h * 4, nullptr, GL_DYNAMIC_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    m_write_idx = 0;
+    return m_pbo[0] != 0;
+}
+
+void CaptureBackend::destroy() {
+    if (m_mapped) release();
+    for (int i = 0; i < N_SLOTS; i++) if (m_fence[i]) { glDeleteSync(m_fence[i]); m_fence[i] = 0; }
+    if (m_pbo[0]) glDeleteBuffers(N_SLOTS, m_pbo);
+    for (int i = 0; i < N_SLOTS; i++) m_pbo[i] = 0;
+}
+
+void CaptureBackend::end_frame() {
+    glBindFramebuffer(GL_FRAMEBUFFER, window_fbo());
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void CaptureBackend::blit_from(GLuint src_fbo, GLuint dst_fbo, CaptureGeom const& geom) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, src_fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, dst_fbo);
+    if (geom.has_bars()) {
+        // cocos sets its clear color once and expects it to stay
+        GLfloat prev_clear[4];
+        glGetFloatv(GL_COLOR_CLEAR_VALUE, prev_clear);
+        glClearColor(0.f, 0.f, 0.f, 1.f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glClearColor(prev_clear[0], prev_clear[1], prev_clear[2], prev_clear[3]);
+    }
+    glBlitFramebuffer(geom.sx, geom.sy, geom.sx + geom.sw, geom.sy + geom.sh,
+        geom.dx, geom.dy, geom.dx + geom.dw, geom.dy + geom.dh, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+}
+
+bool CaptureBackend::blit_window(GLuint dst_fbo, CaptureGeom const& geom) {
+    blit_from(window_fbo(), dst_fbo, geom);
+    return true;
+}
+
+void CaptureBackend::read(int x, int y) {
+    int i = m_write_idx;
+    m_write_idx = (i + 1) % N_SLOTS;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbo[i]);
+    glReadPixels(x, y, m_w, m_h, read_format(), GL_UNSIGNED_BYTE, 0);
+    if (m_fence[i]) { glDeleteSync(m_fence[i]); m_fence[i] = 0; }
+    m_fence[i] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+}
+
+uint8_t const* CaptureBackend::acquire() {
+    int i = read_slot();
+    if (!m_fence[i]) return nullptr;
+    GLint signaled = 0;
+    glGetSynciv(m_fence[i], GL_SYNC_STATUS, 1, nullptr, &signaled);
+    if (signaled != GL_SIGNALED) return nullptr;
+    glDeleteSync(m_fence[i]); m_fence[i] = 0;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbo[i]);
+#ifdef GEODE_IS_MACOS
+    void* p_pix = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+#else
+    void* p_pix = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)m_w * m_h * 4, GL_MAP_READ_BIT);
+#endif
+    m_mapped = p_pix != nullptr;
+    return (uint8_t const*)p_pix;
+}
+
+void CaptureBackend::release() {
+    if (!m_mapped) return;
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    m_mapped = false;
+}
+
+#if !defined(GEODE_IS_ANDROID) && !defined(ECHOCLIP_STANDALONE_GL)
+#define ECHOCLIP_DESKTOP_CAPTURE
+class DesktopCapture : public CaptureBackend {
+public:
+    const char* name() const override { return "desktop gl"; }
+    FrameFmt format() const override { return FrameFmt::BGRA; }
+
+protected:
+    GLenum read_format() const override { return GL_BGRA; }
+};
+#endif
+
+class GlesCapture : public CaptureBackend {
+public:
+    ~GlesCapture() override {
+        if (m_resolve_fbo) glDeleteFramebuffers(1, &m_resolve_fbo);
+        if (m_resolve_rb) glDeleteRenderbuffers(1, &m_resolve_rb);
+    }
+
+    const char* name() const override { return "gles 3"; }
+
+    void begin_frame(int winW, int winH) override {
+        CaptureBackend::begin_frame(winW, winH);
+        // egl surfaces dont have to be fbo 0 (and whatever cocos bound last is the one it presents), ask instead of assuming
+        GLint fb = 0;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &fb);
+        m_window_fbo = (GLuint)fb;
+        GLint samples = 0;
+        glGetIntegerv(GL_SAMPLE_BUFFERS, &samples);
+        m_msaa = samples > 0;
+    }
+
+    GLuint window_fbo() const override { return m_window_fbo; }
+    bool can_read_window() const override { return !m_msaa; }
+
+    bool blit_window(GLuint dst_fbo, CaptureGeom const& geom) override {
+        if (!m_msaa) { blit_from(m_window_fbo, dst_fbo, geom); return true; }
+        // gles 3 only blits a multisampled buffer 1:1, resolve the whole window first and scale from that
+        if (!ensure_resolve()) return false;
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, m_window_fbo);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_resolve_fbo);
+        glBlitFramebuffer(0, 0, m_win_w, m_win_h, 0, 0, m_win_w, m_win_h, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        blit_from(m_resolve_fbo, dst_fbo, geom);
+        return true;
+    }
+
+    FrameFmt format() const override { return FrameFmt::RGBA; }
+
+protected:
+    // the one format/type pair glReadPixels has to support on every gles 3 driver
+    GLenum read_format() const override { return GL_RGBA; }
+
+private:
+    bool ensure_resolve() {
+        if (m_resolve_fbo && m_resolve_w == m_win_w && m_resolve_h == m_win_h) return m_resolve_ok;
+        if (!m_resolve_fbo) { glGenFramebuffers(1, &m_resolve_fbo); glGenRenderbuffers(1, &m_resolve_rb); }
+        glBindRenderbuffer(GL_RENDERBUFFER, m_resolve_rb);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, m_win_w, m_win_h);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_resolve_fbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_resolve_rb);
+        m_resolve_ok = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, m_window_fbo);
+        m_resolve_w = m_win_w; m_resolve_h = m_win_h;
+        return m_resolve_ok;
+    }
+
+    GLuint m_window_fbo = 0;
+    bool m_msaa = false;
+    GLuint m_resolve_fbo = 0;
+    GLuint m_resolve_rb = 0;
+    int m_resolve_w = 0, m_resolve_h = 0;
+    bool m_resolve_ok = false;
+};
+
+std::unique_ptr<CaptureBackend> make_capture_backend([[maybe_unused]] char const* gl_version) {
+#ifdef ECHOCLIP_DESKTOP_CAPTURE
+    if (!gl_version || std::strncmp(gl_version, "OpenGL ES", 9) != 0) return std::make_unique<DesktopCapture>();
+#endif
+    return std::make_unique<GlesCapture>();
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "capture_gl.hpp"
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include "common/capture_geom.hpp"
+#include "common/frame_view.hpp"
+
+// async readback, a ring of pbos with a fence each. read() kicks one off, acquire() hands back an older one once the gpu is done with it
+// desktop gl reads BGRA straight into the pbo. gles 3 only promises RGBA, the swap happens in the one copy out (copy_frame)
+// and knows the egl window surface can be multisampled, which gles wont scale or read from directly
+// nothing in here touches geode or the game, everything it needs comes in through the calls
+class CaptureBackend {
+public:
+    virtual ~CaptureBackend();
+    virtual const char* name() const = 0;
+
+    // pbo ring for w x h frames
+    bool setup(int w, int h);
+    void destroy();
+    bool ready() const { return m_pbo[0] != 0; }
+    // slot the next read() goes into, the gpu timer queries are kept per slot too
+    int write_slot() const { return m_write_idx; }
+    // slot the next acquire() maps
+    int read_slot() const { return (m_write_idx + 1) % N_SLOTS; }
+
+    // call before touching the window this frame, end_frame() puts the window framebuffer back
+    virtual void begin_frame(int winW, int winH) { m_win_w = winW; m_win_h = winH; }
+    void end_frame();
+    // framebuffer the game just drew into
+    virtual GLuint window_fbo() const { return 0; }
+    // glReadPixels can take the window as is
+    virtual bool can_read_window() const { return true; }
+    // scales (and crops/letterboxes) the window into dst_fbo, false if the backend couldnt (dst is left as it was)
+    virtual bool blit_window(GLuint dst_fbo, CaptureGeom const& geom);
+
+    // readback of the bound GL_READ_FRAMEBUFFER at x,y into the next slot
+    void read(int x, int y);
+    // the slot from a frame ago, mapped, if its fence has signaled. null if its not ready, release() once done with it
+    uint8_t const* acquire();
+    // what acquire() hands back
+    virtual FrameFmt format() const = 0;
+    void release();
+
+    static constexpr int N_SLOTS = 3;
+
+protected:
+    virtual GLenum read_format() const = 0;
+    void blit_from(GLuint src_fbo, GLuint dst_fbo, CaptureGeom const& geom);
+
+    int m_w = 0, m_h = 0;
+    int m_win_w = 0, m_win_h = 0;
+
+private:
+    GLuint m_pbo[N_SLOTS] = {0, 0, 0};
+    GLsync m_fence[N_SLOTS] = {0, 0, 0};
+    int m_write_idx = 0;
+    bool m_mapped = false;
+};
+
+// picked by the context's GL_VERSION, not the platform, so ES contexts on desktop (angle, mesa) get the gles path too
+std::unique_ptr<CaptureBackend> make_capture_backend(char const* gl_version);
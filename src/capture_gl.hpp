@@ -0,0 +1,8 @@
+#pragma once
+// gl for the capture unit. the mod gets it through cocos, ECHOCLIP_STANDALONE_GL builds it against plain gles 3 headers
+// (a surfaceless egl context on mesa, no geode, no game). only the gles backend exists there, GL_BGRA isnt in those headers
+#ifdef ECHOCLIP_STANDALONE_GL
+#include <GLES3/gl3.h>
+#else
+#include <Geode/Geode.hpp>
+#endif
@@ -0,0 +1,52 @@
+#include "capture_geom.hpp"
+#include <algorithm>
+
+CaptureAspect parse_capture_aspect(std::string const& s) {
+    if (s == "crop-16:9") return CaptureAspect::Crop16x9;
+    if (s == "letterbox-16:9") return CaptureAspect::Letterbox16x9;
+    return CaptureAspect::Native;
+}
+
+bool CaptureGeom::has_bars() const {
+    return dx > 0 || dy > 0;
+}
+
+bool CaptureGeom::is_direct(int recW, int recH) const {
+    return sw == recW && sh == recH && dx == 0 && dy == 0 && dw == recW && dh == recH;
+}
+
+CaptureGeom compute_capture_geom(int winW, int winH, int recW, int recH, CaptureAspect mode) {
+    CaptureGeom g;
+    g.sw = winW; g.sh = winH;
+    g.dw = recW; g.dh = recH;
+    if (winW <= 0 || winH <= 0 || recW <= 0 || recH <= 0) return g;
+
+    // cross multiplied so nothing rounds, win is wider than rec when winW/winH > recW/recH
+    long long lhs = (long long)winW * recH;
+    long long rhs = (long long)recW * winH;
+    if (lhs == rhs || mode == CaptureAspect::Native) return g;
+
+    if (mode == CaptureAspect::Crop16x9) {
+        if (lhs > rhs) {
+            g.sw = (int)((long long)winH * recW / recH);
+            g.sx = (winW - g.sw) / 2;
+        } else {
+            g.sh = (int)((long long)winW * recH / recW);
+            g.sy = (winH - g.sh) / 2;
+        }
+    } else {
+        if (lhs > rhs) {
+            g.dh = std::max(2, (int)((long long)recW * winH / winW) & ~1);
+            g.dy = (recH - g.dh) / 2;
+        } else {
+            g.dw = std::max(2, (int)((long long)recH * winW / winH) & ~1);
+            g.dx = (recW - g.dw) / 2;
+        }
+    }
+    return g;
+}
+
+int align_dim(int v, int align) {
+    align = std::max(2, align);
+    return std::max(align, v - v % align);
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <string>
+
+enum class CaptureAspect {
+    Native,
+    Crop16x9,
+    Letterbox16x9,
+};
+
+CaptureAspect parse_capture_aspect(std::string const& s);
+
+// where the blit reads from in the window and where it lands in the recording, GL coords (bottom left origin)
+struct CaptureGeom {
+    int sx = 0, sy = 0, sw = 0, sh = 0;
+    int dx = 0, dy = 0, dw = 0, dh = 0;
+    // the picture doesnt cover the whole frame, bars have to be cleared
+    bool has_bars() const;
+    // 1:1 copy, glReadPixels can pull it straight from the window without a blit
+    bool is_direct(int recW, int recH) const;
+};
+
+// crop only reads the middle of the window so discarded pixels never reach the readback
+CaptureGeom compute_capture_geom(int winW, int winH, int recW, int recH, CaptureAspect mode);
+
+// rounds down to a multiple of align (2 minimum, encoders want even dims), never below one block
+int align_dim(int v, int align);
@@ -1,9 +1,27 @@
 #include "common.hpp"
+#include "file_jobs.hpp"
+#include "capture_geom.hpp"
 #include <Geode/Geode.hpp>
+#include <Geode/utils/file.hpp>
 #include <chrono>
 #include <thread>
 #include <algorithm>
 #include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <atomic>
+#include <ctime>
+
+#ifndef GEODE_IS_WINDOWS
+#include <pthread.h>
+#include <sys/resource.h>
+#ifdef GEODE_IS_MACOS
+#include <pthread/qos.h>
+#else
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+#endif
 
 using namespace geode::prelude;
 namespace fs = std::filesystem;
@@ -17,16 +35,6 @@ bool check_cpu_bad() {
     return cores < 4;
 }
 
-void cleanup_temp_folder() {
-    std::error_code ec;
-    fs::path temp_dir = Mod::get()->getSaveDir() / "temp";
-    if (fs::exists(temp_dir, ec)) {
-        for (auto const& entry : fs::directory_iterator(temp_dir, ec)) {
-            fs::remove(entry.path(), ec);
-        }
-    }
-}
-
 void get_target_rec_size(int& outW, int& outH) {
     std::string outputRes = Mod::get()->getSettingValue<std::string>("output-res");
     int targetH = 720;
@@ -38,7 +46,13 @@ void get_target_rec_size(int& outW, int& outH) {
     float userScale = (float)Mod::get()->getSettingValue<int64_t>("recording-scale") / 100.0f;
     targetH = (int)(targetH * userScale);
 
-    int targetW = (int)(targetH * 16.0f / 9.0f);
+    // native follows the window, the 16:9 modes get cropped or letterboxed into shape by the blit
+    float aspect = 16.0f / 9.0f;
+    if (parse_capture_aspect(Mod::get()->getSettingValue<std::string>("capture-aspect")) == CaptureAspect::Native) {
+        CCSize fs = CCDirector::get()->getOpenGLView()->getFrameSize();
+        if (fs.width > 0 && fs.height > 0) aspect = fs.width / fs.height;
+    }
+    int targetW = (int)(targetH * aspect);
 
     if (Mod::get()->getSettingValue<bool>("auto-performance")) {
         if (check_cpu_bad() || check_vram_low()) {
@@ -47,8 +61,9 @@ void get_target_rec_size(int& outW, int& outH) {
         }
     }
 
-    targetW &= ~1;
-    targetH &= ~1;
+    int align = Mod::get()->getSettingValue<bool>("align-16") ? 16 : 2;
+    targetW = align_dim(targetW, align);
+    targetH = align_dim(targetH, align);
 
     outW = targetW;
     outH = targetH;
@@ -74,6 +89,7 @@ void cleanup_old_clips(const fs::path& p_root_clips) {
                 auto diff_hours = std::chrono::duration_cast<std::chrono::hours>(now_sys - sclock).count();
                 if (diff_hours > max_days * 24) {
                     fs::remove(dir_entry.path(), ec);
+                    fs::remove(sidecar_path(dir_entry.path()), ec);
                     continue;
                 }
             }
@@ -91,9 +107,198 @@ void cleanup_old_clips(const fs::path& p_root_clips) {
     for (size_t i = 0; i < vFiles.size() && nTotal > max_bytes; i++) {
         std::error_code e;
         nTotal -= fs::file_size(vFiles[i], e); fs::remove(vFiles[i], e);
+        fs::remove(sidecar_path(vFiles[i]), e);
+    }
+}
+
+static inline uint64_t rotl64(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+// xxh64 style rounds over 4 lanes
+uint64_t hash_frame(const uint8_t* p_data, size_t n) {
+    const uint64_t P1 = 0x9E3779B185EBCA87ull, P2 = 0xC2B2AE3D27D4EB4Full;
+    uint64_t acc[4] = {P1 + P2, P2, 0, 0 - P1};
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        for (int l = 0; l < 4; l++) {
+            uint64_t w; memcpy(&w, p_data + i + l * 8, 8);
+            acc[l] = rotl64(acc[l] + w * P2, 31) * P1;
+        }
+    }
+    uint64_t h = rotl64(acc[0], 1) + rotl64(acc[1], 7) + rotl64(acc[2], 12) + rotl64(acc[3], 18) + (uint64_t)n;
+    for (; i < n; i++) h = rotl64(h ^ (p_data[i] * P1), 11) * P2;
+    h ^= h >> 33; h *= P2; h ^= h >> 29;
+    return h;
+}
+
+// every row, padding skipped. a one pixel particle still has to count as a change, so no sampling
+uint64_t hash_frame_rows(const uint8_t* p_data, size_t row_bytes, size_t stride, int rows) {
+    if (rows <= 0) return 0;
+    if (stride == row_bytes) return hash_frame(p_data, row_bytes * (size_t)rows);
+    uint64_t h = 0;
+    for (int y = 0; y < rows; y++) h = rotl64(h, 5) ^ hash_frame(p_data + (size_t)y * stride, row_bytes);
+    return h;
+}
+
+// bits per second that fits dur_s of video into size_mb, mp4 overhead is roughly 1-2% plus the moov so leave 3% + 64kb spare
+int64_t get_target_bitrate(double dur_s, int64_t size_mb) {
+    if (dur_s <= 0.1 || size_mb <= 0) return 0;
+    double budget_bits = (double)size_mb * 1024.0 * 1024.0 * 8.0 * 0.97 - 64.0 * 1024.0 * 8.0;
+    int64_t br = (int64_t)(budget_bits / dur_s);
+    return std::max<int64_t>(br, 100000);
+}
+
+// saves run side by side (hotkey, new best, complete), every temp they make needs its own name
+static fs::path unique_save_temp(const char* prefix, const char* ext) {
+    static std::atomic<int> s_n{0};
+    return Mod::get()->getSaveDir() / "temp" / fmt::format("{}{}_{}{}", prefix, (long long)::time(0), s_n.fetch_add(1), ext);
+}
+
+std::vector<std::string> build_target_size_passes(std::string const& ff_bin, const fs::path& src, const fs::path& dst, double dur_s, std::string const& null_sink, fs::path& out_passlog, std::string const& extra_in) {
+    std::vector<std::string> passes;
+    int64_t size_mb = Mod::get()->getSettingValue<int64_t>("target-size-mb");
+    int64_t br = get_target_bitrate(dur_s, size_mb);
+    if (br <= 0) return passes;
+
+    // hw encoders cant do 2 pass so this always goes through x264, first pass is fast and only makes the stats file
+    out_passlog = unique_save_temp("_pass_", "");
+    std::string log_p = geode::utils::string::pathToString(out_passlog);
+    std::string src_s = geode::utils::string::pathToString(src);
+    passes.push_back(fmt::format("{} -y -i \"{}\" -c:v libx264 -preset veryfast -b:v {} -pass 1 -passlogfile \"{}\" -pix_fmt yuv420p -an -f null {}",
+        ff_bin, src_s, br, log_p, null_sink));
+    // sized to be uploaded (discord), moov up front so it starts playing in the embed before the whole file is in
+    passes.push_back(fmt::format("{} -y -i \"{}\" {} -metadata title=\"EchoClip\" -c:v libx264 -preset medium -b:v {} -maxrate {} -bufsize {} -pass 2 -passlogfile \"{}\" -pix_fmt yuv420p -movflags +faststart \"{}\"",
+        ff_bin, src_s, extra_in, br, br * 3 / 2, br * 2, log_p, geode::utils::string::pathToString(dst)));
+    geode::log::info("target size {} MB over {:.1f}s -> {} kbps", size_mb, dur_s, br / 1000);
+    return passes;
+}
+
+void cleanup_save_temps(std::vector<fs::path> const& own) {
+    std::error_code ec;
+    fs::path temp_dir = Mod::get()->getSaveDir() / "temp";
+    std::vector<std::string> prefixes;
+    for (auto const& p : own) if (!p.empty()) prefixes.push_back(geode::utils::string::pathToString(p.filename()));
+    if (prefixes.empty()) return;
+    // x264 hangs -0.log, -0.log.mbtree etc off the passlog name, so match on the prefix
+    for (auto const& entry : fs::directory_iterator(temp_dir, ec)) {
+        std::string name = geode::utils::string::pathToString(entry.path().filename());
+        for (auto const& pre : prefixes) {
+            if (name == pre || (name.starts_with(pre) && name[pre.size()] == '-')) { fs::remove(entry.path(), ec); break; }
+        }
+    }
+}
+
+static std::string event_title(ClipEvent const& e) {
+    if (e.kind == "attempt") return fmt::format("Attempt {}", e.value);
+    if (e.kind == "death") return fmt::format("Death {}%", e.value);
+    if (e.kind == "new_best") return fmt::format("New Best {}%", e.value);
+    if (e.kind == "practice") return e.value ? "Practice On" : "Practice Off";
+    if (e.kind == "complete") return "Complete";
+    if (e.kind == "hotkey") return "Clip";
+    return e.kind;
+}
+
+// ffmetadata escaping, these chars are special in the format
+static std::string meta_escape(std::string const& s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '=' || c == ';' || c == '#' || c == '\\' || c == '\n') out += '\\';
+        out += c;
     }
+    return out;
+}
+
+// every event starts a chapter that runs until the next one, ffmpeg maps them into the mp4 with -map_chapters
+fs::path write_chapter_meta(std::vector<ClipEvent> const& events, double dur_s, std::string const& lvl) {
+    if (events.empty() || dur_s <= 0) return {};
+    std::string txt = fmt::format(";FFMETADATA1\ntitle={}\n", meta_escape(lvl));
+    for (size_t i = 0; i < events.size(); i++) {
+        int64_t start_ms = (int64_t)(std::clamp(events[i].t, 0.0, dur_s) * 1000.0);
+        int64_t end_ms = (int64_t)((i + 1 < events.size() ? std::clamp(events[i + 1].t, 0.0, dur_s) : dur_s) * 1000.0);
+        if (end_ms <= start_ms) end_ms = start_ms + 1;
+        txt += fmt::format("\n[CHAPTER]\nTIMEBASE=1/1000\nSTART={}\nEND={}\ntitle={}\n", start_ms, end_ms, meta_escape(event_title(events[i])));
+    }
+    fs::path p = unique_save_temp("_meta_", ".txt");
+    if (geode::utils::file::writeString(p, txt).isErr()) return {};
+    return p;
+}
+
+std::string chapter_input_args(const fs::path& meta_p) {
+    if (meta_p.empty()) return "";
+    return fmt::format("-i \"{}\" -map 0:v -map_chapters 1", geode::utils::string::pathToString(meta_p));
+}
+
+fs::path sidecar_path(const fs::path& clip_p) {
+    fs::path p = clip_p;
+    return p.replace_extension(".json");
+}
+
+// plain json next to the clip so the gallery and other tools can find deaths etc without opening the video
+void write_clip_sidecar(const fs::path& clip_p, std::string const& lvl, int att, double dur_s, std::vector<ClipEvent> const& events) {
+    matjson::Value root = matjson::Value::object();
+    root["level"] = lvl;
+    root["attempt"] = att;
+    root["duration"] = dur_s;
+    std::vector<matjson::Value> evs;
+    for (auto const& e : events) {
+        matjson::Value ev = matjson::Value::object();
+        ev["t"] = e.t;
+        ev["type"] = e.kind;
+        ev["value"] = e.value;
+        evs.push_back(ev);
+    }
+    root["events"] = evs;
+    std::string txt = root.dump();
+    FileJobs::get().write_file(sidecar_path(clip_p), std::vector<uint8_t>(txt.begin(), txt.end()));
+}
+
+static std::atomic<int> s_prio_level{1};
+
+void set_thread_priority_level(int lvl) { s_prio_level.store(std::clamp(lvl, 0, 2)); }
+int get_thread_priority_level() { return s_prio_level.load(); }
+
+int parse_thread_priority(std::string const& s) {
+    if (s == "normal") return 0;
+    if (s == "idle") return 2;
+    return 1;
+}
+
+// game thread frame times, split by whether we were recording, so the cost of recording shows up as a p95/p99 difference
+struct FrameStats {
+    std::vector<float> samples;
+    double t_last_dump = 0;
+};
+
+void record_frame_time(double ms, bool recording) {
+    static FrameStats stats[2];
+    if (ms <= 0 || ms > 1000) return;
+    FrameStats& st = stats[recording ? 1 : 0];
+    st.samples.push_back((float)ms);
+    double now = get_time_val();
+    if (st.t_last_dump == 0) st.t_last_dump = now;
+    if (now - st.t_last_dump < 10.0 || st.samples.size() < 60) return;
+
+    std::vector<float> v = st.samples;
+    std::sort(v.begin(), v.end());
+    auto pct = [&v](double p) { return v[std::min(v.size() - 1, (size_t)(p * (double)v.size()))]; };
+    geode::log::info("frame time ({}): p50 {:.2f}ms p95 {:.2f}ms p99 {:.2f}ms max {:.2f}ms over {} frames",
+        recording ? "recording" : "not recording", pct(0.5), pct(0.95), pct(0.99), v.back(), v.size());
+    st.samples.clear();
+    st.t_last_dump = now;
 }
 
 #ifndef GEODE_IS_WINDOWS
 bool check_vram_low() { return false; }
+
+// no soft affinity on mac or linux, lowering the thread is as far as it goes
+void note_main_thread() {}
+
+void apply_worker_thread_policy() {
+    int lvl = get_thread_priority_level();
+#ifdef GEODE_IS_MACOS
+    pthread_set_qos_class_self_np(lvl == 2 ? QOS_CLASS_BACKGROUND : lvl == 1 ? QOS_CLASS_UTILITY : QOS_CLASS_DEFAULT, 0);
+#else
+    // linux nice is per thread
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), lvl == 2 ? 19 : lvl == 1 ? 5 : 0);
+#endif
+}
 #endif
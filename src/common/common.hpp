@@ -4,17 +4,66 @@
 #include <filesystem>
 #include <vector>
 
+// something that happened during a recording, t is seconds into the video
+struct ClipEvent {
+    double t;
+    std::string kind;
+    int value;
+};
+
 double get_time_val();
 bool check_cpu_bad();
 bool check_vram_low();
-void cleanup_temp_folder();
 void get_target_rec_size(int& outW, int& outH);
 void cleanup_old_clips(const std::filesystem::path& p_root_clips);
+uint64_t hash_frame(const uint8_t* p_data, size_t n);
+uint64_t hash_frame_rows(const uint8_t* p_data, size_t row_bytes, size_t stride, int rows);
+int64_t get_target_bitrate(double dur_s, int64_t size_mb);
+// removes the passlog / chapter files one save made, and anything ffmpeg hung off their names
+void cleanup_save_temps(std::vector<std::filesystem::path> const& own);
+// moves temp/ aside right away and clears it on a background job. after a crash the newest recording gets remuxed into clips/Recovered first
+void run_startup_housekeeping();
+std::filesystem::path write_chapter_meta(std::vector<ClipEvent> const& events, double dur_s, std::string const& lvl);
+std::string chapter_input_args(const std::filesystem::path& meta_p);
+void write_clip_sidecar(const std::filesystem::path& clip_p, std::string const& lvl, int att, double dur_s, std::vector<ClipEvent> const& events);
+std::filesystem::path sidecar_path(const std::filesystem::path& clip_p);
+
+// 0 normal, 1 below normal, 2 idle. applies to every echoclip thread and the ffmpeg children
+void set_thread_priority_level(int lvl);
+int get_thread_priority_level();
+int parse_thread_priority(std::string const& s);
+void note_main_thread();
+void apply_worker_thread_policy();
+void record_frame_time(double ms, bool recording);
+// where a save spends its time, from the trigger to "Clip Saved!" on screen. stamped as it goes, logged at the end
+struct SaveTiming {
+    double t_request = 0;
+    double t_drained = 0;
+    double t_stopped = 0;
+    double t_encoded = 0;
+    double t_cleaned = 0;
+    double t_shown = 0;
+    void log(const char* path) const;
+};
+// shared save path, see save.cpp. transcodes through run_child so it can time out and report progress
+// out_w/h/fps is what the clip should come out as, a recording that already is that can skip the re-encode with fast-save
+void save_clip(std::filesystem::path srcPath, std::string sLvlName, int nAttempts, double dur_s, int out_w, int out_h, int out_fps, std::vector<ClipEvent> events, SaveTiming timing);
+// replay buffer mode, stream copies from_s..to_s seconds before the end of ring segment upto_seq into clips/
+void save_replay(std::string sLvlName, int nAttempts, double from_s, double to_s, uint64_t upto_seq, SaveTiming timing);
+// "<label> N%" toast for background jobs, any thread. concurrent jobs each get their own part of the same toast
+// label has to outlive the job (string literal), the toast goes away with the last end_job_progress
+int begin_job_progress(const char* label);
+void show_job_progress(int job, float frac);
+void end_job_progress(int job);
+// crf args save_clip encodes with, per codec
+std::string default_encode_args(std::string const& codec);
+std::vector<std::string> build_target_size_passes(std::string const& ff_bin, const std::filesystem::path& src, const std::filesystem::path& dst, double dur_s, std::string const& null_sink, std::filesystem::path& out_passlog, std::string const& extra_in = "");
 
 // plat. specific shit
 std::string get_codec();
 int64_t get_total_ram_mb();
-void save_clip(std::filesystem::path srcPath, std::string sLvlName, int nAttempts);
+// bundled ffmpeg from the ffmpeg-api mod, empty if its not loaded
+std::filesystem::path get_ffmpeg_path();
 
 #ifdef GEODE_IS_WINDOWS
 bool is_running_under_wine();
@@ -0,0 +1,240 @@
+#include <Geode/Geode.hpp>
+#include <Geode/utils/async.hpp>
+#include <Geode/utils/file.hpp>
+#include "compile.hpp"
+#include "common.hpp"
+#include "process.hpp"
+#include "file_jobs.hpp"
+#include "../ui.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <atomic>
+#include <cstdlib>
+#include <ctime>
+
+using namespace geode::prelude;
+namespace fs = std::filesystem;
+
+static std::atomic<bool> s_compiling{false};
+
+bool ClipParams::same_stream(ClipParams const& o) const {
+    // fps off by rounding in the dump still counts as the same
+    return video == o.video && pix_fmt == o.pix_fmt && encoder == o.encoder && w == o.w && h == o.h && std::abs(fps - o.fps) < 0.01;
+}
+
+// "  Stream #0:0: Video: h264 (High) (avc1 / 0x31637661), yuv420p(progressive), 1280x720, 4521 kb/s, 60 fps, ..."
+static void parse_video_line(std::string const& line, ClipParams& out) {
+    size_t v = line.find("Video: ");
+    if (v == std::string::npos || out.ok()) return;
+    std::string rest = line.substr(v + 7);
+    std::vector<std::string> parts;
+    int depth = 0;
+    std::string cur;
+    // commas inside brackets (color info) dont split
+    for (char c : rest) {
+        if (c == '(') depth++;
+        if (c == ')') depth--;
+        if (c == ',' && depth == 0) { parts.push_back(cur); cur.clear(); continue; }
+        cur += c;
+    }
+    parts.push_back(cur);
+    for (auto& p : parts) {
+        while (!p.empty() && p[0] == ' ') p.erase(0, 1);
+    }
+    if (parts.empty()) return;
+    // drop the "(avc1 / 0x...)" tag, containers disagree on it and it doesnt matter for a copy
+    std::string vid = parts[0];
+    size_t tag = vid.find(" / 0x");
+    if (tag != std::string::npos) {
+        size_t open = vid.rfind(" (", tag);
+        if (open != std::string::npos) vid = vid.substr(0, open);
+    }
+    out.video = vid;
+    if (parts.size() > 1) out.pix_fmt = parts[1].substr(0, parts[1].find('('));
+    for (auto const& p : parts) {
+        int w = 0, h = 0;
+        if (out.w == 0 && std::sscanf(p.c_str(), "%dx%d", &w, &h) == 2 && w > 0 && h > 0) { out.w = w; out.h = h; }
+        size_t f = p.find(" fps");
+        if (f != std::string::npos && out.fps == 0) out.fps = std::atof(p.substr(0, f).c_str());
+    }
+}
+
+// "      encoder         : Lavc60.31.102 libx264" under the video stream (ENCODER in mkv). the container has its own
+// encoder line (the muxer, Lavf...) before any stream, so only lines after the video one count. lavc version doesnt matter
+static void parse_encoder_line(std::string const& line, ClipParams& out) {
+    if (!out.ok() || !out.encoder.empty()) return;
+    size_t colon = line.find(':');
+    if (colon == std::string::npos) return;
+    std::string key = line.substr(0, colon);
+    while (!key.empty() && key.back() == ' ') key.pop_back();
+    while (!key.empty() && key.front() == ' ') key.erase(0, 1);
+    if (key != "encoder" && key != "ENCODER") return;
+    std::string val = line.substr(colon + 1);
+    while (!val.empty() && val.back() == ' ') val.pop_back();
+    size_t sp = val.rfind(' ');
+    val = sp == std::string::npos ? val : val.substr(sp + 1);
+    // just "Lavc60.31.102" without a name says nothing about the encoder
+    if (val.rfind("Lav", 0) != 0) out.encoder = val;
+}
+
+ClipParams probe_clip(std::string const& ff_bin, fs::path const& p) {
+    ClipParams out;
+    // no output file, ffmpeg dumps the input and exits with an error, thats expected
+    ProcOptions opts;
+    opts.timeout_s = 20.0;
+    opts.merge_stderr = true;
+    opts.on_line = [&out](std::string const& line) {
+        size_t d = line.find("Duration: ");
+        if (d != std::string::npos) {
+            int hh = 0, mm = 0; double ss = 0;
+            if (std::sscanf(line.c_str() + d + 10, "%d:%d:%lf", &hh, &mm, &ss) == 3) out.dur_s = hh * 3600.0 + mm * 60.0 + ss;
+        }
+        parse_encoder_line(line, out);
+        parse_video_line(line, out);
+    };
+    run_child(fmt::format("{} -hide_banner -i \"{}\"", ff_bin, geode::utils::string::pathToString(p)), opts);
+    return out;
+}
+
+// "h264 (High)" -> "high", what -profile:v takes. empty if theres no profile in the dump or its not h264/hevc
+static std::string profile_arg(std::string const& video, std::string const& codec) {
+    if (video.rfind("h264", 0) != 0 && video.rfind("hevc", 0) != 0) return "";
+    size_t open = video.find(" (");
+    size_t close = video.find(')', open);
+    if (open == std::string::npos || close == std::string::npos) return "";
+    std::string prof;
+    for (char c : video.substr(open + 2, close - open - 2)) {
+        if (c == ' ' || c == ':') continue;
+        prof += (char)std::tolower((unsigned char)c);
+    }
+    if (prof == "constrainedbaseline") return "baseline";
+    if (prof == "high444predictive") return codec == "libx264" ? "high444" : "high444p";
+    return prof;
+}
+
+bool compile_clips_async(std::vector<std::pair<fs::path, std::string>> clips) {
+    if (clips.size() < 2) return false;
+    if (s_compiling.exchange(true)) return false;
+
+    geode::async::spawn([in = std::move(clips)]() mutable -> arc::Future<> {
+        std::error_code ec;
+        bool success = false;
+        int job = begin_job_progress("Compiling");
+        // oldest first, a progress compilation reads in the order it was played
+        std::vector<std::pair<fs::file_time_type, size_t>> order;
+        for (size_t i = 0; i < in.size(); i++) order.push_back({fs::last_write_time(in[i].first, ec), i});
+        std::stable_sort(order.begin(), order.end(), [](auto const& a, auto const& b) { return a.first < b.first; });
+        std::vector<fs::path> clips;
+        for (auto const& o : order) clips.push_back(in[o.second].first);
+        std::string lvl = in[order[0].second].second;
+        fs::path out_p = Mod::get()->getSaveDir() / "clips" / lvl / fmt::format("{}_compilation_{}.mp4", lvl, (long long)::time(0));
+        fs::path work_dir = Mod::get()->getSaveDir() / "temp" / fmt::format("_comp_{}", rand() % 100000);
+        fs::path ff_path = get_ffmpeg_path();
+
+        // only favorites picked, the level might not have a folder in clips/ (yet)
+        fs::create_directories(out_p.parent_path(), ec);
+        if (!ff_path.empty() && fs::exists(ff_path, ec) && fs::create_directories(work_dir, ec)) {
+            std::string ff_bin = "\"" + geode::utils::string::pathToString(ff_path) + "\"";
+            double t_start = get_time_val();
+
+            std::vector<ClipParams> params;
+            for (size_t i = 0; i < clips.size(); i++) {
+                params.push_back(probe_clip(ff_bin, clips[i]));
+                show_job_progress(job, 0.05f * (float)(i + 1) / (float)clips.size());
+            }
+
+            // whatever format most of the clips are in wins, so the fewest get re-encoded
+            size_t ref = 0;
+            int best = 0;
+            for (size_t i = 0; i < params.size(); i++) {
+                if (!params[i].ok()) continue;
+                int n = 0;
+                for (auto const& o : params) if (o.ok() && o.same_stream(params[i])) n++;
+                if (n > best) { best = n; ref = i; }
+            }
+            ClipParams const& rp = params[ref];
+
+            // re-encodes are the slow part, progress is weighted by their length
+            double total_dur = 0, done_dur = 0;
+            for (auto const& p : params) if (!p.same_stream(rp)) total_dur += std::max(1.0, p.dur_s);
+
+            bool ok = rp.ok();
+            int n_fixed = 0;
+            std::vector<fs::path> parts;
+            // same encoder, profile and pix fmt as the reference, concat -c copy keeps only its sps/pps
+            std::string codec = rp.encoder.empty() ? get_codec() : rp.encoder;
+            std::string pix_fmt = rp.pix_fmt.empty() ? "yuv420p" : rp.pix_fmt;
+            std::string profile = profile_arg(rp.video, codec);
+            std::string enc_args = default_encode_args(codec) + fmt::format(" -pix_fmt {}", pix_fmt);
+            if (!profile.empty()) enc_args += " -profile:v " + profile;
+            for (size_t i = 0; i < clips.size() && ok; i++) {
+                if (params[i].same_stream(rp)) { parts.push_back(clips[i]); continue; }
+                fs::path fixed = work_dir / fmt::format("fix_{:03}.mp4", i);
+                // pad instead of stretch if the aspect is different, fps filter drops/dupes to the reference rate
+                std::string cmd = fmt::format("{} -y -i \"{}\" -map 0:v:0 -vf \"scale={}:{}:force_original_aspect_ratio=decrease,pad={}:{}:(ow-iw)/2:(oh-ih)/2,fps={:.3f},format={}\" -c:v {} {} \"{}\"",
+                    ff_bin, geode::utils::string::pathToString(clips[i]), rp.w, rp.h, rp.w, rp.h, rp.fps, pix_fmt,
+                    codec, enc_args, geode::utils::string::pathToString(fixed));
+                ProcOptions opts;
+                double d = std::max(1.0, params[i].dur_s);
+                opts.timeout_s = 120.0 + d * 10.0;
+                opts.progress_dur_s = d;
+                opts.on_progress = [job, done_dur, d, total_dur](float p) {
+                    show_job_progress(job, 0.05f + 0.85f * (float)((done_dur + p * d) / total_dur));
+                };
+                ProcOutcome r = run_child(cmd, opts);
+                if (!r.ok()) { log::warn("compile: re-encode of {} failed (exit {})", geode::utils::string::pathToString(clips[i].filename()), r.code); ok = false; break; }
+                done_dur += d;
+                n_fixed++;
+                parts.push_back(fixed);
+            }
+
+            if (ok) {
+                std::string list;
+                for (auto const& p : parts) {
+                    std::string ps = geode::utils::string::pathToString(p);
+                    std::replace(ps.begin(), ps.end(), '\\', '/');
+                    list += fmt::format("file '{}'\n", ps);
+                }
+                fs::path list_p = work_dir / "list.txt";
+                ok = geode::utils::file::writeString(list_p, list).isOk();
+                if (ok) {
+                    show_job_progress(job, 0.95f);
+                    // compilations get shared, same as the target size export. the moov pass is a copy of a file thats already on disk
+                    std::string cmd = fmt::format("{} -y -f concat -safe 0 -i \"{}\" -map 0:v -c copy -metadata title=\"EchoClip\" -movflags +faststart \"{}\"",
+                        ff_bin, geode::utils::string::pathToString(list_p), geode::utils::string::pathToString(out_p));
+                    ProcOptions opts;
+                    opts.timeout_s = 300.0;
+                    ok = run_child(cmd, opts).ok() && fs::exists(out_p, ec);
+                }
+            }
+            if (!ok) fs::remove(out_p, ec);
+            success = ok;
+
+            double total_s = 0;
+            for (auto const& p : params) total_s += p.dur_s;
+            if (success) write_clip_sidecar(out_p, lvl, 0, total_s, {});
+            log::info("compile: {} clips ({} re-encoded) into {:.1f}s of video in {:.1f}s, {}", clips.size(), n_fixed, total_s,
+                get_time_val() - t_start, success ? "ok" : "failed");
+        }
+        fs::remove_all(work_dir, ec);
+        end_job_progress(job);
+        s_compiling.store(false);
+
+        // behind the sidecar job, so the refresh sees it
+        FileJobs::get().submit([success] {
+            Loader::get()->queueInMainThread([success] {
+                if (!CCDirector::get()->getRunningScene()) return;
+                if (success) {
+                    Notification::create("Compilation Saved!", CCSprite::createWithSpriteFrameName("GJ_completesIcon_001.png"))->show();
+                    Gallery::refresh();
+                } else {
+                    Notification::create("Compile Failed!", CCSprite::createWithSpriteFrameName("GJ_deleteBtn_001.png"))->show();
+                }
+            });
+        });
+        co_return;
+    });
+    return true;
+}
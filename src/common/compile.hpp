@@ -0,0 +1,26 @@
+#pragma once
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+
+// what concat needs to match for a stream copy, read off ffmpeg's input dump
+struct ClipParams {
+    std::string video;  // codec + profile, eg "h264 (High)"
+    std::string pix_fmt;
+    // "libx264", "h264_nvenc"... off the stream's encoder tag. different encoders write different sps/pps
+    // and concat -c copy keeps only the first clip's, so they never count as the same stream
+    std::string encoder;
+    int w = 0, h = 0;
+    double fps = 0;
+    double dur_s = 0;
+    bool ok() const { return w > 0 && h > 0 && !video.empty(); }
+    bool same_stream(ClipParams const& o) const;
+};
+
+ClipParams probe_clip(std::string const& ff_bin, std::filesystem::path const& p);
+
+// joins the clips oldest first into one file under the oldest clip's level, background job with a progress toast
+// clips are path + level name. the ones matching the majority format are stream copied, only the odd ones out get
+// re-encoded to match with the same encoder/profile. false if a compile is already running
+bool compile_clips_async(std::vector<std::pair<std::filesystem::path, std::string>> clips);
@@ -0,0 +1,51 @@
+#include <Geode/Geode.hpp>
+#include <Geode/utils/file.hpp>
+#include <Geode/utils/string.hpp>
+#include "file_jobs.hpp"
+#include "common.hpp"
+
+namespace fs = std::filesystem;
+
+FileJobs& FileJobs::get() {
+    // leaked on purpose, the thread just dies with the process
+    static FileJobs* inst = new FileJobs();
+    return *inst;
+}
+
+FileJobs::FileJobs() {
+    worker = std::thread([this] { run(); });
+}
+
+void FileJobs::write_file(fs::path p, std::vector<uint8_t> data) {
+    std::lock_guard<std::mutex> l(m_mtx);
+    jobs.push_back({std::move(p), std::move(data), nullptr});
+    m_cv.notify_one();
+}
+
+void FileJobs::submit(std::function<void()> job) {
+    std::lock_guard<std::mutex> l(m_mtx);
+    jobs.push_back({{}, {}, std::move(job)});
+    m_cv.notify_one();
+}
+
+void FileJobs::run() {
+    int applied_prio = -1;
+    while (true) {
+        if (applied_prio != get_thread_priority_level()) {
+            applied_prio = get_thread_priority_level();
+            apply_worker_thread_policy();
+        }
+        Job job;
+        {
+            std::unique_lock<std::mutex> lk(m_mtx);
+            m_cv.wait(lk, [this] { return !jobs.empty(); });
+            job = std::move(jobs.front()); jobs.pop_front();
+        }
+
+        if (job.fn) {
+            job.fn();
+        } else if (geode::utils::file::writeBinary(job.p, job.data).isErr()) {
+            geode::log::warn("file jobs: failed to write {}", geode::utils::string::pathToString(job.p));
+        }
+    }
+}
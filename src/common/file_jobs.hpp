@@ -0,0 +1,35 @@
+#pragma once
+#include <filesystem>
+#include <functional>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstdint>
+
+// one long lived thread for the small file work the mod does itself (sidecars, gallery file ops, gallery scans), so the main thread
+// never sits on the disk. jobs run one at a time in the order they came in, a job queued after a write sees it on disk
+// the recording isnt in here, ffmpeg-api's Recorder opens and writes its output file itself
+class FileJobs {
+public:
+    static FileJobs& get();
+
+    void write_file(std::filesystem::path p, std::vector<uint8_t> data);
+    void submit(std::function<void()> job);
+
+private:
+    struct Job {
+        std::filesystem::path p;
+        std::vector<uint8_t> data;
+        std::function<void()> fn;
+    };
+
+    FileJobs();
+    void run();
+
+    std::deque<Job> jobs;
+    std::mutex m_mtx;
+    std::condition_variable m_cv;
+    std::thread worker;
+};
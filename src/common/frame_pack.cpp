@@ -0,0 +1,103 @@
+#include "frame_pack.hpp"
+#include <cstring>
+#include <algorithm>
+
+static constexpr uint32_t OP_LIT = 0, OP_REP = 1, OP_UP = 2;
+static constexpr size_t MAX_RUN = 1 << 14;
+
+static inline uint32_t ld(uint8_t const* p, size_t i) {
+    uint32_t v;
+    std::memcpy(&v, p + i * 4, 4);
+    return v;
+}
+
+bool pack_frame(uint8_t const* src, int w, int h, std::vector<uint8_t>& out) {
+    if (w <= 0 || h <= 0) return false;
+    size_t n = (size_t)w * h, row = (size_t)w;
+    size_t limit = n * 3;
+    // scratch is reused per thread, only the packed bytes get copied out
+    thread_local std::vector<uint8_t> buf;
+    if (buf.size() < n * 4 + 64) buf.resize(n * 4 + 64);
+    uint8_t* o = buf.data();
+    size_t pos = 0, i = 0, lit_start = 0;
+
+    auto put_tok = [&](uint32_t op, size_t c) {
+        uint16_t t = (uint16_t)((op << 14) | (uint32_t)(c - 1));
+        o[pos++] = (uint8_t)(t & 0xff);
+        o[pos++] = (uint8_t)(t >> 8);
+    };
+    auto flush_lit = [&](size_t end) {
+        while (lit_start < end) {
+            size_t c = std::min(end - lit_start, MAX_RUN);
+            put_tok(OP_LIT, c);
+            std::memcpy(o + pos, src + lit_start * 4, c * 4);
+            pos += c * 4;
+            lit_start += c;
+        }
+    };
+
+    while (i < n) {
+        if (pos + (i - lit_start) * 4 + 16 > limit) return false;
+        if (i >= row) {
+            size_t j = i;
+            while (j < n && j - i < MAX_RUN && ld(src, j) == ld(src, j - row)) j++;
+            if (j - i >= 2) {
+                flush_lit(i);
+                put_tok(OP_UP, j - i);
+                i = lit_start = j;
+                continue;
+            }
+        }
+        uint32_t p = ld(src, i);
+        size_t j = i + 1;
+        while (j < n && j - i < MAX_RUN && ld(src, j) == p) j++;
+        // a 2 pixel repeat costs the same as the literal
+        if (j - i >= 3) {
+            flush_lit(i);
+            put_tok(OP_REP, j - i);
+            std::memcpy(o + pos, &p, 4);
+            pos += 4;
+            i = lit_start = j;
+            continue;
+        }
+        i++;
+    }
+    flush_lit(n);
+    if (pos > limit) return false;
+    out.assign(o, o + pos);
+    return true;
+}
+
+bool unpack_frame(uint8_t const* src, size_t len, int w, int h, uint8_t* dst) {
+    if (w <= 0 || h <= 0) return false;
+    size_t n = (size_t)w * h, row = (size_t)w;
+    size_t i = 0, pos = 0;
+    while (pos + 2 <= len) {
+        uint32_t t = (uint32_t)src[pos] | ((uint32_t)src[pos + 1] << 8);
+        pos += 2;
+        uint32_t op = t >> 14;
+        size_t c = (t & 0x3fff) + 1;
+        if (i + c > n) return false;
+        if (op == OP_LIT) {
+            if (pos + c * 4 > len) return false;
+            std::memcpy(dst + i * 4, src + pos, c * 4);
+            pos += c * 4;
+        } else if (op == OP_REP) {
+            if (pos + 4 > len) return false;
+            for (size_t k = 0; k < c; k++) std::memcpy(dst + (i + k) * 4, src + pos, 4);
+            pos += 4;
+        } else if (op == OP_UP) {
+            if (i < row) return false;
+            // a run longer than a row reads pixels it just wrote, copy a row at a time so nothing overlaps
+            for (size_t done = 0; done < c;) {
+                size_t k = std::min(c - done, row);
+                std::memcpy(dst + (i + done) * 4, dst + (i + done - row) * 4, k * 4);
+                done += k;
+            }
+        } else {
+            return false;
+        }
+        i += c;
+    }
+    return i == n && pos == len;
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// lossless packing for queued BGRA frames. gd frames are mostly flat colour and tiles that repeat down the screen,
+// so runs of one pixel and runs that match the row above cover most of a frame
+// stream is 16 bit tokens (2 bit op, 14 bit count-1): LIT n + n pixels, REP n + one pixel, UP n (copy from one row up)
+
+// false if the frame didnt shrink to at least 3/4, not worth the unpack then. out is sized to the packed bytes
+bool pack_frame(uint8_t const* src, int w, int h, std::vector<uint8_t>& out);
+// false on anything malformed, dst has to hold w*h*4
+bool unpack_frame(uint8_t const* src, size_t len, int w, int h, uint8_t* dst);
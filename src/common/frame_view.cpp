@@ -0,0 +1,27 @@
+#include "frame_view.hpp"
+#include <cstring>
+
+static void swizzle_row(uint8_t const* src, uint8_t* dst, size_t n_px) {
+    for (size_t i = 0; i < n_px; i++) {
+        uint32_t v;
+        std::memcpy(&v, src + i * 4, 4);
+        v = (v & 0xff00ff00u) | ((v & 0xffu) << 16) | ((v >> 16) & 0xffu);
+        std::memcpy(dst + i * 4, &v, 4);
+    }
+}
+
+void copy_frame(FrameView const& v, uint8_t* dst) {
+    if (!v.data || v.w <= 0 || v.h <= 0) return;
+    size_t row = (size_t)v.w * 4;
+    size_t stride = v.stride > 0 ? (size_t)v.stride : row;
+    if (v.fmt == FrameFmt::BGRA && stride == row) {
+        std::memcpy(dst, v.data, row * v.h);
+        return;
+    }
+    for (int y = 0; y < v.h; y++) {
+        uint8_t const* s = v.data + stride * y;
+        uint8_t* d = dst + row * y;
+        if (v.fmt == FrameFmt::RGBA) swizzle_row(s, d, (size_t)v.w);
+        else std::memcpy(d, s, row);
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+
+enum class FrameFmt {
+    BGRA,
+    RGBA,
+};
+
+// a frame someone else owns (a mapped pbo), only good until release runs
+struct FrameView {
+    uint8_t const* data = nullptr;
+    int w = 0, h = 0;
+    // bytes per row, 0 = w * 4
+    int stride = 0;
+    FrameFmt fmt = FrameFmt::BGRA;
+    // output frame index, -1 = right after the last one. a jump ahead gets filled with repeats
+    int64_t pts = -1;
+    std::function<void()> release;
+};
+
+// the one copy a frame gets on our side: view -> tightly packed BGRA in dst (w * h * 4), converted on the way
+void copy_frame(FrameView const& v, uint8_t* dst);
@@ -0,0 +1,116 @@
+#include <Geode/Geode.hpp>
+#include <Geode/utils/async.hpp>
+#include "common.hpp"
+#include "compile.hpp"
+#include "process.hpp"
+#include <ctime>
+
+using namespace geode::prelude;
+namespace fs = std::filesystem;
+
+static bool is_recording_file(fs::path const& p) {
+    std::string name = geode::utils::string::pathToString(p.filename());
+    std::string ext = geode::utils::string::pathToString(p.extension());
+    if (ext != ".mkv" && ext != ".mp4") return false;
+    // temp pool slots, one off files and ring segments. _tmp_ etc are half finished saves, nothing to salvage there
+    return name.starts_with("seg_") || name.starts_with("r_") || name.starts_with("ring_");
+}
+
+// bytes and files under a dir moved aside by an earlier housekeeping pass
+static uintmax_t size_of(fs::path const& dir, int& n_files) {
+    std::error_code ec;
+    uintmax_t n = 0;
+    for (auto const& e : fs::recursive_directory_iterator(dir, ec)) {
+        if (!e.is_regular_file(ec)) continue;
+        uintmax_t sz = e.file_size(ec);
+        if (!ec) n += sz;
+        n_files++;
+    }
+    return n;
+}
+
+// the attempt that was running when the game died is the newest recording in temp/
+// mkv keeps its clusters readable when cut off, a copy into mp4 gives it a proper index again
+static bool salvage_recording(fs::path const& src, fs::path const& root_clips) {
+    std::error_code ec;
+    fs::path ff_path = get_ffmpeg_path();
+    if (ff_path.empty() || !fs::exists(ff_path, ec)) return false;
+    std::string ff_bin = "\"" + geode::utils::string::pathToString(ff_path) + "\"";
+
+    fs::path dir = root_clips / "Recovered";
+    fs::create_directories(dir, ec);
+    fs::path out = dir / fmt::format("Recovered_{}.mp4", (long long)::time(0));
+
+    ProcOptions opts;
+    opts.timeout_s = 120.0;
+    ProcOutcome r = run_child(fmt::format("{} -y -fflags +genpts+discardcorrupt -i \"{}\" -map 0:v -c copy \"{}\"",
+        ff_bin, geode::utils::string::pathToString(src), geode::utils::string::pathToString(out)), opts);
+
+    ClipParams params;
+    if (r.ok()) params = probe_clip(ff_bin, out);
+    // a cut off mp4 has no moov and nothing to copy, ffmpeg may still leave an empty file behind
+    if (!r.ok() || !params.ok() || params.dur_s <= 0) {
+        log::info("couldnt salvage {} ({})", geode::utils::string::pathToString(src.filename()), r.code);
+        fs::remove(out, ec);
+        return false;
+    }
+    write_clip_sidecar(out, "Recovered", 0, params.dur_s, {});
+    log::info("salvaged {:.1f}s from {}", params.dur_s, geode::utils::string::pathToString(src.filename()));
+    return true;
+}
+
+void run_startup_housekeeping() {
+    bool crashed = Loader::get()->didLastLaunchCrash();
+    std::error_code ec;
+    fs::path save_dir = Mod::get()->getSaveDir();
+    fs::path temp_dir = save_dir / "temp";
+    // the pool and the ring reuse the same slot names every launch, so cleaning temp/ in place could delete a file
+    // a level started meanwhile just reopened. one rename before anything records and the old launch is out of the way
+    if (fs::exists(temp_dir, ec)) {
+        fs::rename(temp_dir, save_dir / fmt::format("temp_old_{}", (long long)::time(0)), ec);
+        if (ec) log::warn("couldnt move the old temp folder aside ({}), leaving it for next launch", ec.message());
+    }
+    fs::create_directories(temp_dir, ec);
+
+    geode::async::spawn([save_dir, crashed]() -> arc::Future<> {
+        double t0 = get_time_val();
+        std::error_code ec;
+
+        // this launch's one and any a previous launch didnt get to finish
+        std::vector<fs::path> old_dirs;
+        for (auto const& entry : fs::directory_iterator(save_dir, ec)) {
+            if (entry.is_directory(ec) && geode::utils::string::pathToString(entry.path().filename()).starts_with("temp_old_"))
+                old_dirs.push_back(entry.path());
+        }
+        if (old_dirs.empty()) co_return;
+
+        fs::path newest;
+        fs::file_time_type newest_t{};
+        for (auto const& dir : old_dirs) {
+            for (auto const& entry : fs::directory_iterator(dir, ec)) {
+                auto t = fs::last_write_time(entry.path(), ec);
+                if (ec || !entry.is_regular_file(ec) || !is_recording_file(entry.path())) continue;
+                if (newest.empty() || t > newest_t) { newest = entry.path(); newest_t = t; }
+            }
+        }
+
+        bool salvaged = crashed && !newest.empty() && salvage_recording(newest, save_dir / "clips");
+
+        uintmax_t reclaimed = 0;
+        int n_removed = 0;
+        for (auto const& dir : old_dirs) {
+            int n = 0;
+            uintmax_t sz = size_of(dir, n);
+            if (fs::remove_all(dir, ec) > 0 && !ec) { reclaimed += sz; n_removed += n; }
+        }
+        log::info("startup housekeeping: {} temp files, {:.1f} MB reclaimed{} in {:.0f}ms", n_removed, (double)reclaimed / (1024.0 * 1024.0),
+            salvaged ? ", 1 recording salvaged" : "", (get_time_val() - t0) * 1000.0);
+
+        if (salvaged) {
+            Loader::get()->queueInMainThread([] {
+                Notification::create("Recovered a clip from the last crash", CCSprite::createWithSpriteFrameName("GJ_completesIcon_001.png"))->show();
+            });
+        }
+        co_return;
+    });
+}
@@ -0,0 +1,46 @@
+#include <Geode/Geode.hpp>
+#include "mem_governor.hpp"
+#include "common.hpp"
+
+MemGovernor& MemGovernor::get() {
+    static MemGovernor inst;
+    return inst;
+}
+
+void MemGovernor::set_limit(int64_t bytes) {
+    m_limit.store(bytes > 0 ? bytes : 0);
+}
+
+bool MemGovernor::try_charge(int64_t n) {
+    int64_t cur = m_live.load();
+    while (true) {
+        if (cur + n > m_limit.load()) {
+            // this is the backpressure path, it can hit every frame while an old session drains so keep the log quiet
+            double now = get_time_val();
+            double last = m_last_refusal_log.load();
+            if (now - last > 10.0 && m_last_refusal_log.compare_exchange_strong(last, now)) log_usage("over budget, dropping frames");
+            return false;
+        }
+        if (m_live.compare_exchange_weak(cur, cur + n)) break;
+    }
+    bump_peak(cur + n);
+    return true;
+}
+
+void MemGovernor::charge(int64_t n) {
+    bump_peak(m_live.fetch_add(n) + n);
+}
+
+void MemGovernor::release(int64_t n) {
+    m_live.fetch_sub(n);
+}
+
+void MemGovernor::bump_peak(int64_t v) {
+    int64_t p = m_peak.load();
+    while (v > p && !m_peak.compare_exchange_weak(p, v)) {}
+}
+
+void MemGovernor::log_usage(const char* why) {
+    geode::log::info("memory ({}): live {:.1f}MB, peak {:.1f}MB, limit {:.1f}MB", why,
+        (double)live() / (1024.0 * 1024.0), (double)peak() / (1024.0 * 1024.0), (double)limit() / (1024.0 * 1024.0));
+}
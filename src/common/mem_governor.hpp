@@ -0,0 +1,30 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// one memory budget for everything echoclip holds in ram, every session and its frame pool charge against it
+// max-ram-usage used to be per session, so a draining session plus the new one could hold two budgets at once
+class MemGovernor {
+public:
+    static MemGovernor& get();
+
+    void set_limit(int64_t bytes);
+    int64_t limit() const { return m_limit.load(); }
+    // charges n bytes if they fit under the limit, false and nothing charged if not
+    bool try_charge(int64_t n);
+    // for memory we cant refuse (encoder buffers), may push live over the limit
+    void charge(int64_t n);
+    void release(int64_t n);
+
+    int64_t live() const { return m_live.load(); }
+    int64_t peak() const { return m_peak.load(); }
+    void log_usage(const char* why);
+
+private:
+    void bump_peak(int64_t v);
+
+    std::atomic<int64_t> m_limit{512ll * 1024 * 1024};
+    std::atomic<int64_t> m_live{0};
+    std::atomic<int64_t> m_peak{0};
+    std::atomic<double> m_last_refusal_log{0};
+};
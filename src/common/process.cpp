@@ -0,0 +1,337 @@
+#include <Geode/Geode.hpp>
+#include "process.hpp"
+#include "common.hpp"
+#include <Geode/loader/GameEvent.hpp>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <cstdlib>
+
+#ifdef GEODE_IS_WINDOWS
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <spawn.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <cerrno>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+extern char** environ;
+#endif
+
+static std::atomic<bool> s_kill_all{false};
+#ifndef GEODE_IS_WINDOWS
+// every child still running, so shutdown can kill them right there instead of waiting on each runner's loop
+static std::mutex s_live_mtx;
+static std::vector<pid_t> s_live;
+#endif
+
+// ffmpeg writes key=value lines to -progress, out_time_us is where the encoder is in the input
+struct ProgressParser {
+    std::string line;
+    double dur_s = 0;
+    std::function<void(float)> const* cb = nullptr;
+    std::function<void(std::string const&)> const* line_cb = nullptr;
+
+    void feed(const char* p, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            if (p[i] != '\n') { if (p[i] != '\r') line += p[i]; continue; }
+            on_line();
+            line.clear();
+        }
+    }
+
+    // whatever came after the last newline, once the pipe is done
+    void flush() {
+        if (!line.empty()) on_line();
+        line.clear();
+    }
+
+    void on_line() {
+        if (line_cb && *line_cb) (*line_cb)(line);
+        if (!cb || !*cb || dur_s <= 0) return;
+        // out_time_ms is also microseconds, ffmpeg named it wrong and kept it around
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) return;
+        std::string key = line.substr(0, eq);
+        if (key == "out_time_us" || key == "out_time_ms") {
+            long long us = std::strtoll(line.c_str() + eq + 1, nullptr, 10);
+            if (us > 0) (*cb)(std::clamp((float)((double)us / 1e6 / dur_s), 0.f, 1.f));
+        } else if (key == "progress" && line.substr(eq + 1) == "end") {
+            (*cb)(1.f);
+        }
+    }
+};
+
+// the bit after the binary gets the progress flags, only if someone is listening
+static std::string with_progress_flags(std::string const& cmd, bool want_progress) {
+    size_t first_end;
+    if (!cmd.empty() && cmd[0] == '"') {
+        first_end = cmd.find('"', 1);
+        first_end = first_end == std::string::npos ? cmd.size() : first_end + 1;
+    } else {
+        first_end = cmd.find(' ');
+        if (first_end == std::string::npos) first_end = cmd.size();
+    }
+    std::string flags = want_progress ? " -nostdin -nostats -progress pipe:1" : " -nostdin";
+    return cmd.substr(0, first_end) + flags + cmd.substr(first_end);
+}
+
+static bool should_stop(ProcOptions const& opts, double t_start, ProcResult& why) {
+    if (s_kill_all.load()) { why = ProcResult::Cancelled; return true; }
+    if (opts.timeout_s > 0 && get_time_val() - t_start > opts.timeout_s) { why = ProcResult::TimedOut; return true; }
+    return false;
+}
+
+#ifdef GEODE_IS_WINDOWS
+
+static HANDLE get_kill_job() {
+    // every child goes in here, closing the last handle (game exit or crash) takes them all down with it
+    static HANDLE job = [] {
+        HANDLE j = CreateJobObjectA(NULL, NULL);
+        if (j) {
+            JOBOBJECT_EXTENDED_LIMIT_INFORMATION info = {};
+            info.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+            SetInformationJobObject(j, JobObjectExtendedLimitInformation, &info, sizeof(info));
+        }
+        return j;
+    }();
+    return job;
+}
+
+ProcOutcome run_child(std::string const& cmd, ProcOptions const& opts) {
+    ProcOutcome out;
+    std::string full = with_progress_flags(cmd, (bool)opts.on_progress);
+
+    SECURITY_ATTRIBUTES sa = { sizeof(sa), NULL, TRUE };
+    HANDLE rd = NULL, wr = NULL;
+    if (!CreatePipe(&rd, &wr, &sa, 0)) return out;
+    SetHandleInformation(rd, HANDLE_FLAG_INHERIT, 0);
+    HANDLE nul = CreateFileA("NUL", GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, &sa, OPEN_EXISTING, 0, NULL);
+
+    // inherit handles would hand the child every inheritable handle in the game, including the write ends of the other runners' pipes
+    // and then their reads dont hit eof until this child is gone too. the handle list limits it to its own two
+    HANDLE inherit[2] = { wr, nul };
+    DWORD n_inherit = nul != INVALID_HANDLE_VALUE ? 2 : 1;
+    SIZE_T attr_sz = 0;
+    InitializeProcThreadAttributeList(NULL, 1, 0, &attr_sz);
+    std::vector<char> attr_buf(attr_sz);
+    auto attrs = (LPPROC_THREAD_ATTRIBUTE_LIST)attr_buf.data();
+    if (!InitializeProcThreadAttributeList(attrs, 1, 0, &attr_sz)) { CloseHandle(rd); CloseHandle(wr); if (nul != INVALID_HANDLE_VALUE) CloseHandle(nul); return out; }
+    bool attrs_ok = UpdateProcThreadAttribute(attrs, 0, PROC_THREAD_ATTRIBUTE_HANDLE_LIST, inherit, n_inherit * sizeof(HANDLE), NULL, NULL);
+
+    STARTUPINFOEXA si = {};
+    si.StartupInfo.cb = sizeof(si);
+    si.StartupInfo.dwFlags = STARTF_USESTDHANDLES;
+    si.StartupInfo.hStdInput = nul; si.StartupInfo.hStdOutput = wr; si.StartupInfo.hStdError = opts.merge_stderr ? wr : nul;
+    si.lpAttributeList = attrs;
+    PROCESS_INFORMATION pi = {};
+    std::vector<char> buf(full.begin(), full.end()); buf.push_back(0);
+    int lvl = get_thread_priority_level();
+    DWORD prio_class = lvl == 2 ? IDLE_PRIORITY_CLASS : lvl == 1 ? BELOW_NORMAL_PRIORITY_CLASS : 0;
+    BOOL started = attrs_ok && CreateProcessA(NULL, buf.data(), NULL, NULL, TRUE, CREATE_NO_WINDOW | CREATE_SUSPENDED | EXTENDED_STARTUPINFO_PRESENT | prio_class,
+        NULL, NULL, &si.StartupInfo, &pi);
+    DeleteProcThreadAttributeList(attrs);
+    CloseHandle(wr);
+    if (nul != INVALID_HANDLE_VALUE) CloseHandle(nul);
+    if (!started) { CloseHandle(rd); return out; }
+    if (HANDLE job = get_kill_job()) AssignProcessToJobObject(job, pi.hProcess);
+    ResumeThread(pi.hThread);
+
+    ProgressParser parser;
+    parser.dur_s = opts.progress_dur_s;
+    parser.cb = &opts.on_progress;
+    parser.line_cb = &opts.on_line;
+    double t_start = get_time_val();
+    ProcResult stop_why = ProcResult::Ok;
+    bool stopped = false;
+    char rbuf[4096];
+
+    while (true) {
+        DWORD avail = 0;
+        while (PeekNamedPipe(rd, NULL, 0, NULL, &avail, NULL) && avail > 0) {
+            DWORD n = 0;
+            if (!ReadFile(rd, rbuf, std::min<DWORD>(avail, sizeof(rbuf)), &n, NULL) || n == 0) break;
+            parser.feed(rbuf, n);
+        }
+        if (WaitForSingleObject(pi.hProcess, 50) == WAIT_OBJECT_0) break;
+        if (!stopped && should_stop(opts, t_start, stop_why)) {
+            TerminateProcess(pi.hProcess, 1);
+            stopped = true;
+        }
+    }
+    // the last lines (progress=end, probe output) can land between the peek and the exit, read to the broken pipe
+    DWORD n_tail = 0;
+    while (ReadFile(rd, rbuf, sizeof(rbuf), &n_tail, NULL) && n_tail > 0) parser.feed(rbuf, n_tail);
+    parser.flush();
+
+    DWORD code = 1;
+    GetExitCodeProcess(pi.hProcess, &code);
+    CloseHandle(rd); CloseHandle(pi.hProcess); CloseHandle(pi.hThread);
+    out.code = (int)code;
+    out.res = stopped ? stop_why : (code == 0 ? ProcResult::Ok : ProcResult::Failed);
+    return out;
+}
+
+#else
+
+// our commands only ever quote paths with "", no escapes to worry about
+static std::vector<std::string> split_args(std::string const& cmd) {
+    std::vector<std::string> args;
+    std::string cur;
+    bool in_q = false, has_tok = false;
+    for (char c : cmd) {
+        if (c == '"') { in_q = !in_q; has_tok = true; continue; }
+        if (c == ' ' && !in_q) {
+            if (has_tok) args.push_back(cur);
+            cur.clear(); has_tok = false;
+            continue;
+        }
+        cur += c; has_tok = true;
+    }
+    if (has_tok) args.push_back(cur);
+    return args;
+}
+
+ProcOutcome run_child(std::string const& cmd, ProcOptions const& opts) {
+    ProcOutcome out;
+    std::vector<std::string> args = split_args(with_progress_flags(cmd, (bool)opts.on_progress));
+    if (args.empty()) return out;
+    std::vector<char*> argv;
+    for (auto& a : args) argv.push_back(a.data());
+    argv.push_back(nullptr);
+
+    // close on exec, or a child started in parallel by another runner inherits this write end and our read wont see eof until it exits
+    // the child gets its copy through dup2, which drops the flag
+    int fds[2];
+#ifdef __linux__
+    if (pipe2(fds, O_CLOEXEC) != 0) return out;
+#else
+    if (pipe(fds) != 0) return out;
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+#endif
+    pid_t pid = -1;
+    int err = 0;
+#ifdef __linux__
+    // posix_spawn cant set a parent death signal, without one a crashed game leaves ffmpeg running (the job object does this on windows)
+    // the signal is tied to the thread that forked, which is this one and it waits on the child the whole time
+    // only async signal safe calls between fork and exec
+    pid_t parent = getpid();
+    pid = fork();
+    if (pid == 0) {
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if (getppid() != parent) _exit(127);
+        int null_in = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        if (null_in >= 0) dup2(null_in, 0);
+        dup2(fds[1], 1);
+        if (opts.merge_stderr) dup2(fds[1], 2);
+        else {
+            int null_out = open("/dev/null", O_WRONLY | O_CLOEXEC);
+            if (null_out >= 0) dup2(null_out, 2);
+        }
+        execve(argv[0], argv.data(), environ);
+        _exit(127);
+    }
+    if (pid < 0) err = errno;
+#else
+    posix_spawn_file_actions_t fa;
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_addopen(&fa, 0, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&fa, fds[1], 1);
+    if (opts.merge_stderr) posix_spawn_file_actions_adddup2(&fa, fds[1], 2);
+    else posix_spawn_file_actions_addopen(&fa, 2, "/dev/null", O_WRONLY, 0);
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+#ifdef POSIX_SPAWN_CLOEXEC_DEFAULT
+    // the pipe() + fcntl above isnt atomic, this closes anything another thread opened in between too
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_CLOEXEC_DEFAULT);
+#endif
+
+    err = posix_spawn(&pid, argv[0], &fa, &attr, argv.data(), environ);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&fa);
+#endif
+    close(fds[1]);
+    if (err != 0) { close(fds[0]); return out; }
+    {
+        std::lock_guard<std::mutex> l(s_live_mtx);
+        s_live.push_back(pid);
+    }
+
+    int lvl = get_thread_priority_level();
+    if (lvl > 0) setpriority(PRIO_PROCESS, (id_t)pid, lvl == 2 ? 19 : 10);
+
+    ProgressParser parser;
+    parser.dur_s = opts.progress_dur_s;
+    parser.cb = &opts.on_progress;
+    parser.line_cb = &opts.on_line;
+    double t_start = get_time_val();
+    ProcResult stop_why = ProcResult::Ok;
+    bool stopped = false, pipe_open = true;
+    char rbuf[4096];
+    int status = 0;
+
+    while (true) {
+        if (pipe_open) {
+            // everything thats there (capped so a chatty child still gets its timeout checked), not one buffer per tick
+            pollfd pfd = { fds[0], POLLIN, 0 };
+            int wait_ms = 50;
+            for (int reads = 0; pipe_open && reads < 64 && poll(&pfd, 1, wait_ms) > 0; reads++) {
+                ssize_t n = read(fds[0], rbuf, sizeof(rbuf));
+                if (n > 0) parser.feed(rbuf, (size_t)n);
+                else pipe_open = false;
+                wait_ms = 0;
+            }
+        } else {
+            usleep(50 * 1000);
+        }
+        // WNOWAIT leaves it a zombie, so the pid cant be reused before its out of s_live
+        siginfo_t info = {};
+        if (waitid(P_PID, (id_t)pid, &info, WEXITED | WNOHANG | WNOWAIT) != 0 || info.si_pid == pid) break;
+        if (!stopped && should_stop(opts, t_start, stop_why)) {
+            kill(pid, SIGKILL);
+            stopped = true;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> l(s_live_mtx);
+        s_live.erase(std::remove(s_live.begin(), s_live.end(), pid), s_live.end());
+    }
+    waitpid(pid, &status, 0);
+    // the child is gone so this hits eof, the last lines can still be sitting in the pipe
+    while (pipe_open) {
+        ssize_t n = read(fds[0], rbuf, sizeof(rbuf));
+        if (n > 0) parser.feed(rbuf, (size_t)n);
+        else if (n < 0 && errno == EINTR) continue;
+        else pipe_open = false;
+    }
+    parser.flush();
+    close(fds[0]);
+
+    out.code = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+    out.res = stopped ? stop_why : (out.code == 0 ? ProcResult::Ok : ProcResult::Failed);
+    return out;
+}
+
+#endif
+
+void cancel_all_children() {
+    s_kill_all.store(true);
+#ifndef GEODE_IS_WINDOWS
+    std::lock_guard<std::mutex> l(s_live_mtx);
+    for (pid_t pid : s_live) kill(pid, SIGKILL);
+#endif
+}
+
+// a save in flight shouldnt hold the game open on the way out
+$on_game(Exiting) {
+    cancel_all_children();
+}
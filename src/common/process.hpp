@@ -0,0 +1,36 @@
+#pragma once
+#include <string>
+#include <functional>
+
+enum class ProcResult {
+    Ok,
+    Failed,
+    Cancelled,
+    TimedOut,
+    NotStarted,
+};
+
+struct ProcOptions {
+    // 0 = wait forever
+    double timeout_s = 0;
+    // length of the input in seconds, turns ffmpeg -progress output into a 0..1 fraction
+    double progress_dur_s = 0;
+    std::function<void(float)> on_progress;
+    // every line the child prints to stdout (and stderr with merge_stderr), for probing
+    std::function<void(std::string const&)> on_line;
+    bool merge_stderr = false;
+};
+
+struct ProcOutcome {
+    ProcResult res = ProcResult::NotStarted;
+    int code = -1;
+    bool ok() const { return res == ProcResult::Ok; }
+};
+
+// one runner for every ffmpeg child on every platform. CreateProcess + pipe on windows, fork/exec on linux, posix_spawn everywhere else
+// children run at the background priority, get killed on timeout or shutdown and die with the game (job object on windows, pdeathsig on linux)
+// a child only ever inherits its own pipe, so parallel runners dont keep each other's pipes open
+ProcOutcome run_child(std::string const& cmd, ProcOptions const& opts = {});
+
+// kills anything still running, for shutdown
+void cancel_all_children();
@@ -0,0 +1,213 @@
+#include <Geode/Geode.hpp>
+#include <Geode/utils/file.hpp>
+#include "replay_ring.hpp"
+#include "common.hpp"
+#include "process.hpp"
+#include <algorithm>
+
+using namespace geode::prelude;
+namespace fs = std::filesystem;
+
+ReplayRing& ReplayRing::get() {
+    static ReplayRing inst;
+    return inst;
+}
+
+void ReplayRing::configure(int minutes, int64_t max_mb, std::string const& ext) {
+    std::error_code ec;
+    std::lock_guard<std::mutex> l(m_mtx);
+    minutes = std::max(0, minutes);
+    uintmax_t max_bytes = (uintmax_t)std::max<int64_t>(0, max_mb) * 1024 * 1024;
+    if (minutes == m_minutes && max_bytes == m_max_bytes && ext == m_ext) return;
+
+    // turned off or the container changed, the old segments cant be concatenated with new ones anymore
+    // anything still being written or read gets cleaned up by end_segment / the extract once its done
+    if (minutes == 0 || ext != m_ext) {
+        std::vector<Seg> old;
+        old.swap(slots);
+        for (auto& s : old) if (!s.open && s.locks == 0) fs::remove(s.p, ec);
+    }
+    m_minutes = minutes;
+    m_max_bytes = max_bytes;
+    m_ext = ext;
+    evict();
+    if (minutes > 0) geode::log::info("replay buffer: {} min, capped at {}MB on disk", minutes, (long long)max_mb);
+}
+
+void ReplayRing::evict() {
+    std::error_code ec;
+    std::vector<Seg*> held;
+    double held_s = 0;
+    uintmax_t held_bytes = 0;
+    for (auto& s : slots) {
+        if (!s.valid || s.open) continue;
+        held.push_back(&s);
+        held_s += s.dur_s;
+        held_bytes += s.bytes;
+    }
+    std::sort(held.begin(), held.end(), [](Seg* a, Seg* b) { return a->seq < b->seq; });
+    double window_s = m_minutes * 60.0;
+    for (Seg* s : held) {
+        // the oldest one stays while the window still needs part of it
+        bool over_time = held_s - s->dur_s >= window_s;
+        bool over_bytes = m_max_bytes > 0 && held_bytes > m_max_bytes;
+        if (!over_time && !over_bytes) break;
+        // an extract is reading it, it goes on the next pass
+        if (s->locks > 0) continue;
+        held_s -= s->dur_s;
+        held_bytes -= s->bytes;
+        s->valid = false;
+        s->bytes = 0;
+        s->dur_s = 0;
+        fs::remove(s->p, ec);
+    }
+}
+
+bool ReplayRing::enabled() {
+    std::lock_guard<std::mutex> l(m_mtx);
+    return m_minutes > 0;
+}
+
+int ReplayRing::minutes() {
+    std::lock_guard<std::mutex> l(m_mtx);
+    return m_minutes;
+}
+
+fs::path ReplayRing::begin_segment() {
+    std::lock_guard<std::mutex> l(m_mtx);
+    if (m_minutes <= 0) return {};
+    // an evicted slot, then a new one, and only once MAX_SLOTS is hit the oldest segment gets overwritten early
+    Seg* pick = nullptr;
+    for (auto& s : slots) {
+        if (!s.valid && !s.open && s.locks == 0) { pick = &s; break; }
+    }
+    if (!pick && (int)slots.size() < MAX_SLOTS) {
+        std::error_code ec;
+        fs::path d = Mod::get()->getSaveDir() / "temp";
+        fs::create_directories(d, ec);
+        Seg s;
+        s.p = d / fmt::format("ring_{}.{}", slots.size(), m_ext);
+        slots.push_back(s);
+        pick = &slots.back();
+    }
+    if (!pick) {
+        for (auto& s : slots) {
+            if (s.open || s.locks > 0) continue;
+            if (!pick || s.seq < pick->seq) pick = &s;
+        }
+    }
+    if (!pick) return {};
+    pick->open = true;
+    pick->valid = false;
+    pick->seq = next_seq++;
+    pick->dur_s = 0;
+    pick->bytes = 0;
+    return pick->p;
+}
+
+void ReplayRing::end_segment(fs::path const& p, int frames, int w, int h, int fps, std::string const& codec) {
+    std::error_code ec;
+    std::lock_guard<std::mutex> l(m_mtx);
+    for (auto& s : slots) {
+        if (s.p != p || !s.open) continue;
+        s.open = false;
+        s.valid = frames > 0;
+        s.w = w; s.h = h; s.fps = fps;
+        s.codec = codec;
+        s.dur_s = s.fps > 0 ? (double)frames / (double)s.fps : 0;
+        s.bytes = fs::file_size(p, ec);
+        if (ec) { s.bytes = 0; s.valid = false; }
+        bytes_written += s.bytes;
+        evict();
+        return;
+    }
+    // ring got shrunk while this was recording, the slot isnt ours anymore
+    fs::remove(p, ec);
+}
+
+uint64_t ReplayRing::newest_seq() {
+    std::lock_guard<std::mutex> l(m_mtx);
+    uint64_t seq = 0;
+    for (auto& s : slots) if (s.valid && !s.open) seq = std::max(seq, s.seq);
+    return seq;
+}
+
+bool ReplayRing::extract_range(double from_s, double to_s, uint64_t upto_seq, fs::path const& dst, double& out_dur) {
+    std::error_code ec;
+    out_dur = 0;
+    if (from_s <= to_s) return false;
+    fs::path ff_path = get_ffmpeg_path();
+    if (ff_path.empty() || !fs::exists(ff_path, ec)) return false;
+
+    // newest first, each segment covers [back, back + dur) seconds before the end. only the ones overlapping the range get picked
+    // a resolution or codec change ends the run, concat cant copy across it
+    // copies, configure() can reshuffle the slots while ffmpeg runs. locks are matched back up by seq
+    std::vector<Seg> picked;
+    double back = 0, first_back = 0, last_back = 0;
+    {
+        std::lock_guard<std::mutex> l(m_mtx);
+        std::vector<Seg*> done;
+        // segments after upto_seq are the next attempts, they dont count towards the range
+        for (auto& s : slots) if (s.valid && !s.open && s.seq <= upto_seq) done.push_back(&s);
+        std::sort(done.begin(), done.end(), [](Seg* a, Seg* b) { return a->seq > b->seq; });
+        for (Seg* s : done) {
+            if (back >= from_s) break;
+            double seg_back = back;
+            back += s->dur_s;
+            if (back <= to_s) continue;
+            if (!picked.empty() && (s->w != picked[0].w || s->h != picked[0].h || s->codec != picked[0].codec || s->fps != picked[0].fps)) break;
+            if (picked.empty()) first_back = seg_back;
+            last_back = back;
+            s->locks++;
+            picked.push_back(*s);
+        }
+    }
+    if (picked.empty()) return false;
+    std::reverse(picked.begin(), picked.end());
+
+    std::string list;
+    for (Seg const& s : picked) {
+        std::string ps = geode::utils::string::pathToString(s.p);
+        std::replace(ps.begin(), ps.end(), '\\', '/');
+        list += fmt::format("file '{}'\n", ps);
+    }
+    fs::path list_p = Mod::get()->getSaveDir() / "temp" / fmt::format("_ring_{}.txt", rand() % 100000);
+    bool ok = geode::utils::file::writeString(list_p, list).isOk();
+
+    // picked covers last_back..first_back seconds back, cut the range out of that
+    // input side -ss on a copy snaps back to the keyframe before it, so the clip starts a bit early rather than late
+    double skip = std::max(0.0, last_back - from_s);
+    double len = std::min(from_s, last_back) - std::max(to_s, first_back);
+    if (ok) {
+        std::string cmd = fmt::format("\"{}\" -y -f concat -safe 0 -ss {:.3f} -i \"{}\" -t {:.3f} -c copy \"{}\"",
+            geode::utils::string::pathToString(ff_path), skip, geode::utils::string::pathToString(list_p), len, geode::utils::string::pathToString(dst));
+        ProcOptions opts;
+        opts.timeout_s = 120.0;
+        ok = run_child(cmd, opts).ok() && fs::exists(dst, ec);
+    }
+    fs::remove(list_p, ec);
+    if (!ok) fs::remove(dst, ec);
+
+    {
+        std::lock_guard<std::mutex> l(m_mtx);
+        for (Seg const& pk : picked)
+            for (auto& s : slots) if (s.seq == pk.seq && s.locks > 0) s.locks--;
+        if (ok) bytes_extracted += fs::file_size(dst, ec);
+        // whatever got skipped for being locked can go now
+        evict();
+    }
+    out_dur = len;
+    log_stats(ok ? "extracted" : "extract failed");
+    return ok;
+}
+
+void ReplayRing::log_stats(const char* why) {
+    std::lock_guard<std::mutex> l(m_mtx);
+    uintmax_t on_disk = 0;
+    double held_s = 0;
+    for (auto& s : slots) if (s.valid) { on_disk += s.bytes; held_s += s.dur_s; }
+    auto mb = [](uintmax_t b) { return (double)b / (1024.0 * 1024.0); };
+    geode::log::info("replay buffer ({}): {:.0f}s held in {:.1f}MB, {:.1f}MB written total, {:.1f}MB extracted, write amp {:.1f}x",
+        why, held_s, mb(on_disk), mb(bytes_written), mb(bytes_extracted),
+        bytes_extracted > 0 ? (double)bytes_written / (double)bytes_extracted : 0.0);
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+// replay buffer mode, the last N minutes live on disk in a set of segment files that get reused oldest first
+// the recorder rolls to the next slot every SEG_S seconds (see RecSession::roll_segment) and every attempt ends one early,
+// so segments get evicted by the time and bytes they actually hold, not by how many there are
+// each segment starts on a keyframe so any range of the ring can be cut out with a stream copy
+class ReplayRing {
+public:
+    static ReplayRing& get();
+
+    // 0 minutes turns it off. max_mb caps what the closed segments take on disk. the index is dropped if the container changed
+    void configure(int minutes, int64_t max_mb, std::string const& ext);
+    bool enabled();
+    int minutes();
+
+    // oldest slot nobody is extracting from, empty if theyre all busy
+    std::filesystem::path begin_segment();
+    // recorder on p has stopped, frames is what actually made it into the file
+    void end_segment(std::filesystem::path const& p, int frames, int w, int h, int fps, std::string const& codec);
+
+    // seq of the newest closed segment, pins an extract to what was there when the clip got asked for
+    uint64_t newest_seq();
+    // stream copies from `from_s` to `to_s` seconds back from the end of segment upto_seq into dst (to_s = 0 is its end)
+    // blocks so keep it off the main thread
+    bool extract_range(double from_s, double to_s, uint64_t upto_seq, std::filesystem::path const& dst, double& out_dur);
+    void log_stats(const char* why);
+
+    static constexpr int SEG_S = 10;
+    // only a guard on the file count, fast resets make lots of short segments and the bytes cap is what bounds the disk
+    static constexpr int MAX_SLOTS = 1024;
+
+private:
+    struct Seg {
+        std::filesystem::path p;
+        bool open = false;
+        bool valid = false;
+        int locks = 0;
+        uint64_t seq = 0;
+        double dur_s = 0;
+        int w = 0, h = 0, fps = 0;
+        std::string codec;
+        uintmax_t bytes = 0;
+    };
+    // drops the oldest segments until whats left is just over the window and under the bytes cap. caller holds m_mtx
+    void evict();
+
+    std::vector<Seg> slots;
+    uint64_t next_seq = 1;
+    int m_minutes = 0;
+    uintmax_t m_max_bytes = 0;
+    std::string m_ext;
+    // write amplification, everything the ring wrote vs what ever got pulled out of it
+    uintmax_t bytes_written = 0;
+    uintmax_t bytes_extracted = 0;
+    std::mutex m_mtx;
+};
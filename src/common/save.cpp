@@ -0,0 +1,295 @@
+#include <Geode/Geode.hpp>
+#include "common.hpp"
+#include "process.hpp"
+#include "transcode.hpp"
+#include "replay_ring.hpp"
+#include "compile.hpp"
+#include "file_jobs.hpp"
+#include <Geode/utils/async.hpp>
+#include <Geode/utils/string.hpp>
+#include "../ui.hpp"
+#include <ctime>
+#include <cstdlib>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+using namespace geode::prelude;
+namespace fs = std::filesystem;
+
+#ifdef GEODE_IS_WINDOWS
+static constexpr const char* NULL_SINK = "NUL";
+#else
+static constexpr const char* NULL_SINK = "/dev/null";
+#endif
+
+// one toast for every background job in flight, each job keeps its own line in it ("Saving 40% | Compiling 12%")
+// s_jobs is shared with the job threads, the toast itself is only touched on the main thread
+struct JobProgress {
+    int id;
+    const char* label;
+    int pct;
+};
+static std::mutex s_jobs_mtx;
+static std::vector<JobProgress> s_jobs;
+static std::atomic<int> s_next_job{1};
+static Ref<Notification> s_progress_notif;
+
+static void update_progress_toast() {
+    Loader::get()->queueInMainThread([] {
+        std::string txt;
+        {
+            std::lock_guard<std::mutex> l(s_jobs_mtx);
+            for (auto const& j : s_jobs) {
+                if (j.pct < 0) continue;
+                if (!txt.empty()) txt += " | ";
+                txt += fmt::format("{} {}%", j.label, j.pct);
+            }
+        }
+        if (txt.empty()) {
+            if (s_progress_notif) s_progress_notif->hide();
+            s_progress_notif = nullptr;
+            return;
+        }
+        if (!CCDirector::get()->getRunningScene()) return;
+        if (!s_progress_notif) {
+            s_progress_notif = Notification::create(txt, NotificationIcon::Loading, NOTIFICATION_LASTS_FOREVER);
+            s_progress_notif->show();
+        } else {
+            s_progress_notif->setString(txt);
+        }
+    });
+}
+
+int begin_job_progress(const char* label) {
+    int id = s_next_job.fetch_add(1);
+    std::lock_guard<std::mutex> l(s_jobs_mtx);
+    s_jobs.push_back({id, label, -1});
+    return id;
+}
+
+void show_job_progress(int job, float frac) {
+    int pct = std::clamp((int)(frac * 100.f), 0, 100);
+    {
+        std::lock_guard<std::mutex> l(s_jobs_mtx);
+        auto it = std::find_if(s_jobs.begin(), s_jobs.end(), [job](JobProgress const& j) { return j.id == job; });
+        // the pipe fires a few times a second, only bother the main thread when the number changes
+        if (it == s_jobs.end() || it->pct == pct) return;
+        it->pct = pct;
+    }
+    update_progress_toast();
+}
+
+void end_job_progress(int job) {
+    {
+        std::lock_guard<std::mutex> l(s_jobs_mtx);
+        std::erase_if(s_jobs, [job](JobProgress const& j) { return j.id == job; });
+    }
+    update_progress_toast();
+}
+
+std::string default_encode_args(std::string const& codec) {
+    // videotoolbox has no presets
+    if (codec == "h264_videotoolbox") return "-crf 23 -pix_fmt yuv420p";
+    return "-preset medium -crf 23 -pix_fmt yuv420p";
+}
+
+static char const* proc_result_name(ProcResult r) {
+    switch (r) {
+        case ProcResult::Ok: return "ok";
+        case ProcResult::Failed: return "failed";
+        case ProcResult::Cancelled: return "cancelled";
+        case ProcResult::TimedOut: return "timed out";
+        default: return "never started";
+    }
+}
+
+// level name thats safe as a folder/file name
+static std::string clean_level_name(std::string const& sLvlName) {
+    std::string clean_name = sLvlName;
+    if (clean_name.empty()) clean_name = "Unknown";
+    for (char& c : clean_name)
+        if (c == '/' || c == '\\' || c == ':' || c == '*' || c == '?' || c == '"' || c == '<' || c == '>' || c == '|') c = '_';
+    if (clean_name.size() > 80) clean_name = clean_name.substr(0, 80);
+    return clean_name;
+}
+
+void SaveTiming::log(const char* path) const {
+    auto ms = [](double a, double b) { return (a > 0 && b > 0) ? (b - a) * 1000.0 : 0.0; };
+    geode::log::info("save latency ({}): drain {:.0f}ms, stop {:.0f}ms, encode {:.0f}ms, cleanup {:.0f}ms, ui {:.0f}ms, {:.0f}ms total",
+        path, ms(t_request, t_drained), ms(t_drained, t_stopped), ms(t_stopped, t_encoded), ms(t_encoded, t_cleaned),
+        ms(t_cleaned, t_shown), ms(t_request, t_shown));
+}
+
+// goes through the file thread first, so the gallery refresh lands after the sidecar this save queued
+static void notify_saved(bool success, SaveTiming timing, const char* path) {
+    FileJobs::get().submit([success, timing, path] {
+        Loader::get()->queueInMainThread([success, timing, path]() mutable {
+            if (!CCDirector::get()->getRunningScene()) return;
+            if (success) {
+                Notification::create("Clip Saved!", CCSprite::createWithSpriteFrameName("GJ_completesIcon_001.png"))->show();
+                Gallery::refresh();
+            } else {
+                Notification::create("Save Failed!", CCSprite::createWithSpriteFrameName("GJ_deleteBtn_001.png"))->show();
+            }
+            timing.t_shown = get_time_val();
+            timing.log(path);
+        });
+    });
+}
+
+// a re-encode makes h264 yuv420p at the configured size and fps, a recording thats already that can skip it
+static bool matches_output(ClipParams const& p, int out_w, int out_h, int out_fps) {
+    return p.ok() && p.video.starts_with("h264") && p.pix_fmt == "yuv420p" && p.w == out_w && p.h == out_h && std::abs(p.fps - out_fps) < 0.01;
+}
+
+// settings changed since the recording started (or the capture budget scaled it down), the re-encode brings it back in line
+static std::string conform_args(ClipParams const& p, int out_w, int out_h, int out_fps) {
+    if (!p.ok() || (p.w == out_w && p.h == out_h && std::abs(p.fps - out_fps) < 0.01)) return "";
+    return fmt::format("-vf \"scale={}:{}:force_original_aspect_ratio=decrease,pad={}:{}:(ow-iw)/2:(oh-ih)/2,fps={}\"",
+        out_w, out_h, out_w, out_h, out_fps);
+}
+
+void save_clip(fs::path srcPath, std::string sLvlName, int nAttempts, double dur_s, int out_w, int out_h, int out_fps, std::vector<ClipEvent> events, SaveTiming timing) {
+    std::error_code ec;
+    if (srcPath.empty() || !fs::exists(srcPath, ec)) return;
+    geode::async::spawn([srcPath, sLvlName, nAttempts, dur_s, out_w, out_h, out_fps, events = std::move(events), timing]() mutable -> arc::Future<> {
+        std::error_code ec;
+        fs::path p_root_clips = Mod::get()->getSaveDir() / "clips";
+
+        std::string clean_name = clean_level_name(sLvlName);
+        fs::path p_lvl_dir = p_root_clips / clean_name;
+        fs::create_directories(p_lvl_dir, ec);
+
+        fs::path out_file_path = p_lvl_dir / fmt::format("{}_att{}_{}.mp4", clean_name, nAttempts, (long long)::time(0));
+
+        bool success = false;
+        const char* path = "rename";
+        int job = begin_job_progress("Saving");
+        std::string ff_bin;
+        fs::path ff_path = get_ffmpeg_path();
+        if (!ff_path.empty() && fs::exists(ff_path, ec)) ff_bin = "\"" + geode::utils::string::pathToString(ff_path) + "\"";
+
+        // probing is a header read, tells whether the recording is already what a re-encode would make
+        ClipParams src_params;
+        if (!ff_bin.empty()) src_params = probe_clip(ff_bin, srcPath);
+        // with a match the transcode only buys a smaller file. target size still needs its passes
+        bool fast = Mod::get()->getSettingValue<bool>("fast-save") && Mod::get()->getSettingValue<int64_t>("target-size-mb") <= 0;
+        if (fast && !ff_bin.empty() && !matches_output(src_params, out_w, out_h, out_fps)) {
+            log::info("fast save: recording is {} {} {}x{} @ {:.2f}, output is h264 yuv420p {}x{} @ {}, re-encoding",
+                src_params.video, src_params.pix_fmt, src_params.w, src_params.h, src_params.fps, out_w, out_h, out_fps);
+            fast = false;
+        }
+
+        if (fast && !ff_bin.empty() && srcPath.extension() != ".mp4") {
+            // right stream, wrong container (mkv temp files), a copy into mp4 is still no transcode
+            path = "remux";
+            fs::path meta_p = write_chapter_meta(events, dur_s, sLvlName);
+            ProcOptions opts;
+            opts.timeout_s = 60.0 + dur_s;
+            ProcOutcome r = run_child(fmt::format("{} -y -i \"{}\" {} -c copy -metadata title=\"EchoClip\" \"{}\"",
+                ff_bin, geode::utils::string::pathToString(srcPath), chapter_input_args(meta_p), geode::utils::string::pathToString(out_file_path)), opts);
+            cleanup_save_temps({meta_p});
+            if (r.ok() && fs::exists(out_file_path, ec)) {
+                fs::remove(srcPath, ec);
+                success = true;
+            } else {
+                log::warn("fast save remux {} (exit {}), keeping the recording as is", proc_result_name(r.res), r.code);
+                fs::remove(out_file_path, ec);
+                out_file_path.replace_extension(srcPath.extension());
+                fs::rename(srcPath, out_file_path, ec);
+                if (!ec) success = true;
+            }
+        } else if (!fast) {
+            fs::path tmp_out = Mod::get()->getSaveDir() / "temp" / fmt::format("_tmp_{}_{}.mp4", (long long)::time(0), rand() % 1000);
+            std::string codec = get_codec();
+            std::string encode_args = default_encode_args(codec);
+            std::string conform = conform_args(src_params, out_w, out_h, out_fps);
+            if (!conform.empty()) encode_args += " " + conform;
+
+            bool encoded = false;
+            if (!ff_bin.empty()) {
+                // generous, a stuck ffmpeg should cost a couple minutes at worst, not the clip
+                ProcOptions opts;
+                opts.timeout_s = 120.0 + dur_s * 10.0;
+
+                fs::path meta_p = write_chapter_meta(events, dur_s, sLvlName);
+                fs::path passlog_p;
+                std::string chapters = chapter_input_args(meta_p);
+                std::vector<std::string> passes = build_target_size_passes(ff_bin, srcPath, tmp_out, dur_s, NULL_SINK, passlog_p, chapters);
+                path = passes.empty() ? "re-encode" : "target size";
+                if (passes.empty() && should_chunk_transcode(codec, dur_s)) {
+                    path = "chunked";
+                    opts.on_progress = [job](float p) { show_job_progress(job, p); };
+                    encoded = transcode_chunked(ff_bin, srcPath, tmp_out, dur_s, codec, encode_args, chapters, opts);
+                } else {
+                    if (passes.empty()) {
+                        passes.push_back(fmt::format("{} -y -i \"{}\" {} -metadata title=\"EchoClip\" -c:v {} {} \"{}\"",
+                            ff_bin, geode::utils::string::pathToString(srcPath), chapters, codec, encode_args, geode::utils::string::pathToString(tmp_out)));
+                    }
+                    // passes depend on each other so these block, we're on the async task anyway
+                    encoded = true;
+                    opts.progress_dur_s = dur_s;
+                    for (size_t i = 0; i < passes.size() && encoded; i++) {
+                        float n = (float)passes.size();
+                        opts.on_progress = [job, i, n](float p) { show_job_progress(job, ((float)i + p) / n); };
+                        ProcOutcome r = run_child(passes[i], opts);
+                        if (!r.ok()) {
+                            log::warn("ffmpeg pass {}/{} {} (exit {})", i + 1, passes.size(), proc_result_name(r.res), r.code);
+                            encoded = false;
+                        }
+                    }
+                }
+                cleanup_save_temps({meta_p, passlog_p});
+
+                // a killed or failed run can leave a half written mp4 behind, never keep that over the original
+                if (!encoded) fs::remove(tmp_out, ec);
+            }
+
+            if (encoded && fs::exists(tmp_out, ec)) {
+                fs::remove(srcPath, ec); fs::rename(tmp_out, out_file_path, ec);
+                if (!ec) success = true;
+            } else {
+                out_file_path.replace_extension(srcPath.extension());
+                fs::rename(srcPath, out_file_path, ec);
+                if (!ec) success = true;
+            }
+        } else {
+            // already an mp4 of the right stream (or no ffmpeg to check with). same volume as temp/, so this is a metadata only move
+            out_file_path.replace_extension(srcPath.extension());
+            fs::rename(srcPath, out_file_path, ec);
+            if (!ec) success = true;
+        }
+        end_job_progress(job);
+        timing.t_encoded = get_time_val();
+
+        if (success) write_clip_sidecar(out_file_path, sLvlName, nAttempts, dur_s, events);
+        cleanup_old_clips(p_root_clips);
+        timing.t_cleaned = get_time_val();
+        notify_saved(success, timing, path);
+        co_return;
+    });
+}
+
+void save_replay(std::string sLvlName, int nAttempts, double from_s, double to_s, uint64_t upto_seq, SaveTiming timing) {
+    geode::async::spawn([sLvlName, nAttempts, from_s, to_s, upto_seq, timing]() mutable -> arc::Future<> {
+        std::error_code ec;
+        fs::path p_root_clips = Mod::get()->getSaveDir() / "clips";
+        std::string clean_name = clean_level_name(sLvlName);
+        fs::path p_lvl_dir = p_root_clips / clean_name;
+        fs::create_directories(p_lvl_dir, ec);
+
+        // the ring is already encoded, no transcode here. mp4 out so it plays anywhere, its a copy either way
+        fs::path out_file_path = p_lvl_dir / fmt::format("{}_replay_{}.mp4", clean_name, (long long)::time(0));
+        double dur_s = 0;
+        bool success = ReplayRing::get().extract_range(from_s, to_s, upto_seq, out_file_path, dur_s);
+        timing.t_encoded = get_time_val();
+        if (success) write_clip_sidecar(out_file_path, sLvlName, nAttempts, dur_s, {});
+        cleanup_old_clips(p_root_clips);
+        timing.t_cleaned = get_time_val();
+        notify_saved(success, timing, "replay");
+        co_return;
+    });
+}
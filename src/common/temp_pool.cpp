@@ -0,0 +1,65 @@
+#include <Geode/Geode.hpp>
+#include "temp_pool.hpp"
+#include "common.hpp"
+#include <cstdlib>
+
+using namespace geode::prelude;
+namespace fs = std::filesystem;
+
+TempPool& TempPool::get() {
+    static TempPool inst;
+    return inst;
+}
+
+fs::path TempPool::acquire(std::string const& ext) {
+    std::error_code ec;
+    fs::path d = Mod::get()->getSaveDir() / "temp";
+    fs::create_directories(d, ec);
+
+    std::lock_guard<std::mutex> l(m_mtx);
+    if (slots.empty()) slots.resize(POOL_SZ);
+    for (int n = 0; n < POOL_SZ; n++) {
+        int i = (next_idx + n) % POOL_SZ;
+        if (slots[i].busy) continue;
+        next_idx = (i + 1) % POOL_SZ;
+        fs::path p = d / fmt::format("seg_{}.{}", i, ext);
+        // container setting changed since last time, dont leave the old one lying around
+        if (!slots[i].p.empty() && slots[i].p != p) fs::remove(slots[i].p, ec);
+        slots[i].p = p;
+        slots[i].busy = true;
+        return p;
+    }
+    geode::log::debug("temp pool exhausted, using a one off file");
+    return d / fmt::format("r_{}_{}.{}", (int)get_time_val(), rand() % 100000, ext);
+}
+
+void TempPool::release(fs::path const& p) {
+    std::lock_guard<std::mutex> l(m_mtx);
+    for (auto& s : slots) {
+        if (s.p == p) { s.busy = false; return; }
+    }
+    std::error_code ec;
+    fs::remove(p, ec);
+}
+
+fs::path TempPool::take(fs::path const& p) {
+    std::lock_guard<std::mutex> l(m_mtx);
+    for (auto& s : slots) {
+        if (s.p != p) continue;
+        // same dir so this is just a metadata rename, the slot gets a fresh file from ffmpeg next time
+        std::error_code ec;
+        fs::path out = p.parent_path() / fmt::format("r_{}_{}{}", (int)get_time_val(), rand() % 100000, geode::utils::string::pathToString(p.extension()));
+        fs::rename(p, out, ec);
+        // if the rename failed the save reads straight from the slot, so it has to stay busy
+        if (ec) return p;
+        s.busy = false;
+        return out;
+    }
+    return p;
+}
+
+bool TempPool::owns(fs::path const& p) {
+    std::lock_guard<std::mutex> l(m_mtx);
+    for (auto& s : slots) if (s.p == p) return true;
+    return false;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <mutex>
+
+// fixed set of temp recording files that get reused round robin instead of created and deleted every attempt
+// a file only leaves the pool when it gets saved
+class TempPool {
+public:
+    static TempPool& get();
+
+    // free slot, or a one off file if every slot is still draining
+    std::filesystem::path acquire(std::string const& ext);
+    // attempt was thrown away, the file stays on disk for the next attempt to overwrite
+    void release(std::filesystem::path const& p);
+    // attempt is being saved, renames it out of the pool and returns where it went
+    std::filesystem::path take(std::filesystem::path const& p);
+    bool owns(std::filesystem::path const& p);
+
+    static constexpr int POOL_SZ = 4;
+
+private:
+    struct Slot {
+        std::filesystem::path p;
+        bool busy = false;
+    };
+    std::vector<Slot> slots;
+    int next_idx = 0;
+    std::mutex m_mtx;
+};
@@ -0,0 +1,91 @@
+#include <Geode/Geode.hpp>
+#include <Geode/utils/file.hpp>
+#include "transcode.hpp"
+#include "common.hpp"
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+
+using namespace geode::prelude;
+namespace fs = std::filesystem;
+
+static constexpr double MIN_CHUNK_S = 4.0;
+
+static int chunk_workers() {
+    int cores = (int)std::thread::hardware_concurrency();
+    // each x264 already uses a few threads, so a process per 2 cores keeps the machine busy without thrashing
+    return std::clamp(cores / 2, 1, 8);
+}
+
+bool should_chunk_transcode(std::string const& codec, double dur_s) {
+    return codec == "libx264" && chunk_workers() > 1 && dur_s >= MIN_CHUNK_S * 2;
+}
+
+bool transcode_chunked(std::string const& ff_bin, const fs::path& src, const fs::path& dst, double dur_s,
+    std::string const& codec, std::string const& encode_args, std::string const& extra_in, ProcOptions const& opts, int n_workers) {
+    std::error_code ec;
+    if (n_workers <= 0) n_workers = chunk_workers();
+    int n_chunks = std::clamp((int)(dur_s / MIN_CHUNK_S), 1, n_workers * 2);
+    double seg_s = dur_s / (double)n_chunks;
+
+    fs::path work_dir = Mod::get()->getSaveDir() / "temp" / fmt::format("_chunks_{}", rand() % 100000);
+    fs::create_directories(work_dir, ec);
+    auto cleanup = [&work_dir] { std::error_code e; fs::remove_all(work_dir, e); };
+
+    // segment muxer only cuts on keyframes, so each piece decodes on its own. timestamps restart per piece and concat stitches them back
+    std::string split_cmd = fmt::format("{} -y -i \"{}\" -map 0:v -c copy -f segment -segment_time {:.3f} -reset_timestamps 1 \"{}\"",
+        ff_bin, geode::utils::string::pathToString(src), seg_s, geode::utils::string::pathToString(work_dir / ("in_%03d" + geode::utils::string::pathToString(src.extension()))));
+    // progress is by finished pieces, the split and join are stream copies and barely register
+    ProcOptions step_opts;
+    step_opts.timeout_s = opts.timeout_s;
+    if (!run_child(split_cmd, step_opts).ok()) { cleanup(); return false; }
+
+    std::vector<fs::path> pieces;
+    for (auto const& entry : fs::directory_iterator(work_dir, ec)) {
+        if (geode::utils::string::pathToString(entry.path().filename()).starts_with("in_")) pieces.push_back(entry.path());
+    }
+    std::sort(pieces.begin(), pieces.end());
+    if (pieces.empty()) { cleanup(); return false; }
+
+    std::vector<fs::path> outs(pieces.size());
+    for (size_t i = 0; i < pieces.size(); i++) outs[i] = work_dir / fmt::format("out_{:03}.mp4", i);
+
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> n_done{0};
+    std::atomic<bool> failed{false};
+    std::vector<std::thread> pool;
+    for (int w = 0; w < std::min<int>(n_workers, (int)pieces.size()); w++) {
+        pool.emplace_back([&] {
+            while (!failed.load()) {
+                size_t i = next.fetch_add(1);
+                if (i >= pieces.size()) break;
+                std::string cmd = fmt::format("{} -y -i \"{}\" -c:v {} {} -an \"{}\"",
+                    ff_bin, geode::utils::string::pathToString(pieces[i]), codec, encode_args, geode::utils::string::pathToString(outs[i]));
+                if (!run_child(cmd, step_opts).ok()) { failed.store(true); break; }
+                size_t done = n_done.fetch_add(1) + 1;
+                if (opts.on_progress) opts.on_progress(0.95f * (float)done / (float)pieces.size());
+            }
+        });
+    }
+    for (auto& t : pool) t.join();
+    if (failed.load()) { cleanup(); return false; }
+
+    std::string list;
+    for (auto const& o : outs) {
+        std::string ps = geode::utils::string::pathToString(o);
+        std::replace(ps.begin(), ps.end(), '\\', '/');
+        list += fmt::format("file '{}'\n", ps);
+    }
+    fs::path list_p = work_dir / "list.txt";
+    if (geode::utils::file::writeString(list_p, list).isErr()) { cleanup(); return false; }
+
+    std::string join_cmd = fmt::format("{} -y -f concat -safe 0 -i \"{}\" {} -c copy -metadata title=\"EchoClip\" \"{}\"",
+        ff_bin, geode::utils::string::pathToString(list_p), extra_in, geode::utils::string::pathToString(dst));
+    bool ok = run_child(join_cmd, step_opts).ok() && fs::exists(dst, ec);
+    if (ok && opts.on_progress) opts.on_progress(1.f);
+    geode::log::info("chunked transcode: {} pieces on {} workers, {}", pieces.size(), n_workers, ok ? "ok" : "failed");
+    cleanup();
+    return ok;
+}
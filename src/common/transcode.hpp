@@ -0,0 +1,13 @@
+#pragma once
+#include <string>
+#include <filesystem>
+#include "process.hpp"
+
+// only worth it for cpu encoders on longer clips, hw encoders have a handful of sessions and are fast anyway
+bool should_chunk_transcode(std::string const& codec, double dur_s);
+
+// splits src at keyframes, encodes the pieces in parallel and stream copies them back together into dst
+// false if any step failed, dst is left half written in that case so the caller should fall back
+// n_workers 0 = from the core count
+bool transcode_chunked(std::string const& ff_bin, const std::filesystem::path& src, const std::filesystem::path& dst, double dur_s,
+    std::string const& codec, std::string const& encode_args, std::string const& extra_in, ProcOptions const& opts = {}, int n_workers = 0);
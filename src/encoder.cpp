@@ -0,0 +1,356 @@
+#include "encoder.hpp"
+#include "common/temp_pool.hpp"
+#include "common/mem_governor.hpp"
+#include "common/replay_ring.hpp"
+#include "common/frame_pack.hpp"
+#include <Geode/loader/GameEvent.hpp>
+
+using namespace geode::prelude;
+
+std::vector<uint8_t> RecSession::take_frame() {
+    {
+        std::lock_guard<std::mutex> l(m_p_mtx);
+        if (!pool_frames.empty()) {
+            std::vector<uint8_t> f = std::move(pool_frames.back());
+            pool_frames.pop_back();
+            return f;
+        }
+    }
+    if (frame_bytes <= 0 || !MemGovernor::get().try_charge(frame_bytes)) return {};
+    charged_bytes.fetch_add(frame_bytes);
+    return std::vector<uint8_t>((size_t)frame_bytes);
+}
+
+// callers hold m_p_mtx and m_q_mtx
+void RecSession::recycle_frame(std::vector<uint8_t>&& f) {
+    if (f.empty()) return;
+    if (!dead && (int)pool_frames.size() + raw_queued < max_frames) {
+        pool_frames.push_back(std::move(f));
+        return;
+    }
+    // draining sessions shrink as they go so the live one can grow into the budget
+    std::vector<uint8_t>().swap(f);
+    charged_bytes.fetch_sub(frame_bytes);
+    MemGovernor::get().release(frame_bytes);
+}
+
+void RecSession::charge_encoder_estimate(int n_frames) {
+    int64_t n = frame_bytes * n_frames;
+    MemGovernor::get().charge(n);
+    charged_bytes.fetch_add(n);
+}
+
+bool RecSession::submit(FrameView const& v) {
+    auto release = [&v] { if (v.release) v.release(); };
+    // the view skipped ahead, the ticks in between repeat whatever went out last
+    while (v.pts >= 0 && frames_queued < v.pts) {
+        if (!enqueue(std::vector<uint8_t>())) break;
+    }
+    // identical to the last frame we sent (pause menu, end screen, death freeze), no copy at all
+    // the whole frame is hashed, a thin trail or one hud digit changing is enough to keep it
+    if (skip_dups) {
+        size_t stride = (size_t)(v.stride > 0 ? v.stride : v.w * 4);
+        uint64_t h = hash_frame_rows(v.data, (size_t)v.w * 4, stride, v.h);
+        bool dup = has_last_hash && h == last_hash;
+        last_hash = h; has_last_hash = true;
+        if (dup) {
+            release();
+            enqueue(std::vector<uint8_t>());
+            return false;
+        }
+    }
+    std::vector<uint8_t> buf = take_frame();
+    if (buf.empty()) {
+        // out of budget, hold the previous frame instead of going over
+        has_last_hash = false;
+        release();
+        enqueue(std::vector<uint8_t>());
+        return false;
+    }
+    if ((int64_t)buf.size() != frame_bytes) buf.resize((size_t)frame_bytes);
+    copy_frame(v, buf.data());
+    release();
+    return enqueue(std::move(buf));
+}
+
+bool RecSession::enqueue(std::vector<uint8_t>&& frame) {
+    bool need_schedule = false, need_pack = false;
+    {
+        std::lock_guard<std::mutex> lp(m_p_mtx);
+        std::lock_guard<std::mutex> lq(m_q_mtx);
+        if (dead || (int)c_pixel_q.size() >= max_queue) {
+            recycle_frame(std::move(frame));
+            return false;
+        }
+        if (!frame.empty()) raw_queued++;
+        QFrame q;
+        q.px = std::move(frame);
+        q.seq = next_seq++;
+        c_pixel_q.push_back(std::move(q));
+        frames_queued++;
+        if (!scheduled) { scheduled = true; need_schedule = true; }
+        if (pack && !pack_pending && (int)c_pixel_q.size() > max_frames / 2) { pack_pending = true; need_pack = true; }
+    }
+    if (need_schedule) EncodeService::get().schedule(shared_from_this());
+    if (need_pack) EncodeService::get().schedule_pack(shared_from_this());
+    return true;
+}
+
+bool RecSession::encode_some(int n) {
+    for (int i = 0; i < n; i++) {
+        QFrame q;
+        {
+            std::unique_lock<std::mutex> lk(m_q_mtx);
+            if (c_pixel_q.empty()) {
+                scheduled = false;
+                m_done_cv.notify_all();
+                return false;
+            }
+            // only happens once the queue drained all the way down to where the packer is working
+            m_pack_cv.wait(lk, [this] { return !c_pixel_q.front().packing; });
+            q = std::move(c_pixel_q.front()); c_pixel_q.pop_front();
+            if (!q.packed && !q.px.empty()) raw_queued--;
+        }
+        if (q.px.empty()) {
+            // repeat of the previous frame, nothing was copied for it
+            if (!last_frame.empty()) write_frame(last_frame, true);
+            continue;
+        }
+        if (q.packed) {
+            if (unpack_buf.empty()) {
+                MemGovernor::get().charge(frame_bytes);
+                charged_bytes.fetch_add(frame_bytes);
+                unpack_buf.resize((size_t)frame_bytes);
+            }
+            bool ok = unpack_frame(q.px.data(), q.px.size(), cfg.m_width, cfg.m_height, unpack_buf.data());
+            int64_t packed_n = (int64_t)q.px.size();
+            std::vector<uint8_t>().swap(q.px);
+            charged_bytes.fetch_sub(packed_n);
+            MemGovernor::get().release(packed_n);
+            if (!ok) {
+                if (!last_frame.empty()) write_frame(last_frame, true);
+                continue;
+            }
+            write_frame(unpack_buf, false);
+            // old last_frame (if any) is the next unpack target, no trip through the pool
+            std::swap(unpack_buf, last_frame);
+            continue;
+        }
+        std::vector<uint8_t> c_pixel = std::move(q.px);
+        write_frame(c_pixel, false);
+        std::swap(c_pixel, last_frame);
+        if (c_pixel.empty()) continue;
+        std::lock_guard<std::mutex> l(m_p_mtx);
+        std::lock_guard<std::mutex> lq(m_q_mtx);
+        recycle_frame(std::move(c_pixel));
+    }
+    return true;
+}
+
+void RecSession::pack_some() {
+    while (true) {
+        std::vector<uint8_t> raw;
+        uint64_t seq = 0;
+        {
+            std::lock_guard<std::mutex> lq(m_q_mtx);
+            // newest first, the front of the queue is about to be encoded anyway
+            size_t from = (size_t)std::max(0, max_frames / 2);
+            size_t idx = c_pixel_q.size();
+            for (size_t i = c_pixel_q.size(); i > from; i--) {
+                QFrame& q = c_pixel_q[i - 1];
+                if (!q.packed && !q.packing && !q.pack_skip && !q.px.empty()) { idx = i - 1; break; }
+            }
+            if (idx == c_pixel_q.size()) { pack_pending = false; return; }
+            QFrame& q = c_pixel_q[idx];
+            q.packing = true;
+            raw = std::move(q.px);
+            seq = q.seq;
+        }
+
+        double t0 = get_time_val();
+        std::vector<uint8_t> out;
+        bool ok = pack_frame(raw.data(), cfg.m_width, cfg.m_height, out) && MemGovernor::get().try_charge((int64_t)out.size());
+        int64_t us = (int64_t)((get_time_val() - t0) * 1e6);
+
+        std::lock_guard<std::mutex> lp(m_p_mtx);
+        std::lock_guard<std::mutex> lq(m_q_mtx);
+        // nothing gets popped past a packing entry, so its still at seq - front.seq
+        QFrame& q = c_pixel_q[(size_t)(seq - c_pixel_q.front().seq)];
+        q.packing = false;
+        if (ok) {
+            charged_bytes.fetch_add((int64_t)out.size());
+            pack_frames.fetch_add(1);
+            pack_in_bytes.fetch_add(frame_bytes);
+            pack_out_bytes.fetch_add((int64_t)out.size());
+            pack_us.fetch_add(us);
+            q.px = std::move(out);
+            q.packed = true;
+            raw_queued--;
+            recycle_frame(std::move(raw));
+        } else {
+            q.px = std::move(raw);
+            q.pack_skip = true;
+        }
+        m_pack_cv.notify_all();
+    }
+}
+
+void RecSession::write_frame(std::vector<uint8_t> const& frame, bool dup) {
+    if (seg_frames > 0 && seg_ticks >= seg_frames) roll_segment();
+    seg_ticks++;
+    if (!rec || !rec->writeFrame(frame).isOk()) return;
+    frames_written.fetch_add(1);
+    seg_written++;
+    if (dup) dup_frames.fetch_add(1);
+}
+
+// new recorder means the next segment starts on a keyframe, thats what lets the ring be cut anywhere with a copy
+void RecSession::roll_segment() {
+    if (rec) { rec->stop(); delete rec; rec = nullptr; }
+    close_segment();
+    seg_ticks = 0;
+    seg_written = 0;
+    temp_file_p = ReplayRing::get().begin_segment();
+    // every slot is being extracted from, frames get dropped until the next roll
+    if (temp_file_p.empty()) return;
+    seg_closed = false;
+    cfg.m_outputFile = temp_file_p;
+    ffmpeg::events::Recorder* r = new ffmpeg::events::Recorder();
+    if (r->init(cfg).isOk()) { rec = r; return; }
+    geode::log::warn("replay buffer: recorder failed to init on {}", cfg.m_codec);
+    delete r;
+}
+
+void RecSession::close_segment() {
+    if (seg_frames <= 0 || seg_closed || temp_file_p.empty()) return;
+    seg_closed = true;
+    ReplayRing::get().end_segment(temp_file_p, seg_written, cfg.m_width, cfg.m_height, cfg.m_fps, cfg.m_codec);
+}
+
+// one last trip through the service even if the queue is empty, so the final ref (and rec->stop()) lands on a worker instead of the reset path
+void RecSession::finish() {
+    bool need_schedule = false;
+    {
+        std::lock_guard<std::mutex> lk(m_q_mtx);
+        dead = true;
+        if (!scheduled) { scheduled = true; need_schedule = true; }
+    }
+    if (need_schedule) EncodeService::get().schedule(shared_from_this());
+}
+
+void RecSession::wait_drained() {
+    std::unique_lock<std::mutex> lk(m_q_mtx);
+    // scheduled only drops once a worker finds the queue empty, or the service is shutting down
+    m_done_cv.wait(lk, [this] { return !scheduled; });
+}
+
+RecSession::~RecSession() {
+    // whoever drops the last ref ends up here, a service worker or the main thread, never a thread of our own
+    if (rec) { rec->stop(); delete rec; }
+    if (pack_frames.load() > 0) {
+        int n = pack_frames.load();
+        geode::log::info("frame packing: {} frames at {:.1f}x, {:.2f}ms each", n,
+            (double)pack_in_bytes.load() / (double)std::max<int64_t>(1, pack_out_bytes.load()), (double)pack_us.load() / 1000.0 / n);
+    }
+    MemGovernor::get().release(charged_bytes.load());
+    if (seg_frames > 0) close_segment();
+    else if (!b_saved && !temp_file_p.empty()) TempPool::get().release(temp_file_p);
+}
+
+EncodeService& EncodeService::get() {
+    // leaked so there are never joinable threads left in a static destructor, shutdown() joins them on exit
+    static EncodeService* inst = new EncodeService();
+    return *inst;
+}
+
+EncodeService::EncodeService() {
+    for (int i = 0; i < N_WORKERS; i++) workers.emplace_back([this] { run(); });
+    packer = std::thread([this] { run_packer(); });
+}
+
+void EncodeService::schedule(std::shared_ptr<RecSession> s) {
+    std::lock_guard<std::mutex> l(m_mtx);
+    if (stopping) {
+        std::lock_guard<std::mutex> lq(s->m_q_mtx);
+        s->scheduled = false;
+        s->m_done_cv.notify_all();
+        return;
+    }
+    ready.push_back(std::move(s));
+    m_cv.notify_one();
+}
+
+void EncodeService::schedule_pack(std::shared_ptr<RecSession> s) {
+    std::lock_guard<std::mutex> l(m_mtx);
+    if (stopping) return;
+    pack_ready.push_back(std::move(s));
+    m_pack_cv.notify_one();
+}
+
+void EncodeService::run_packer() {
+    apply_worker_thread_policy();
+    while (true) {
+        std::shared_ptr<RecSession> s;
+        {
+            std::unique_lock<std::mutex> lk(m_mtx);
+            m_pack_cv.wait(lk, [this] { return stopping || !pack_ready.empty(); });
+            if (stopping) break;
+            s = std::move(pack_ready.front()); pack_ready.pop_front();
+        }
+        s->pack_some();
+    }
+}
+
+void EncodeService::run() {
+    int applied_prio = -1;
+    while (true) {
+        // setting can change while the service is up, pick it up between batches
+        if (applied_prio != get_thread_priority_level()) {
+            applied_prio = get_thread_priority_level();
+            apply_worker_thread_policy();
+        }
+        std::shared_ptr<RecSession> s;
+        {
+            std::unique_lock<std::mutex> lk(m_mtx);
+            m_cv.wait(lk, [this] { return stopping || !ready.empty(); });
+            if (stopping) break;
+            s = std::move(ready.front()); ready.pop_front();
+        }
+        // small batches then back of the line, so a draining session cant starve the live one
+        if (s->encode_some(BATCH_FRAMES)) {
+            std::lock_guard<std::mutex> l(m_mtx);
+            if (!stopping) { ready.push_back(std::move(s)); m_cv.notify_one(); continue; }
+            std::lock_guard<std::mutex> lq(s->m_q_mtx);
+            s->scheduled = false;
+            s->m_done_cv.notify_all();
+        }
+    }
+}
+
+void EncodeService::shutdown() {
+    {
+        std::lock_guard<std::mutex> l(m_mtx);
+        if (stopping) return;
+        stopping = true;
+        m_cv.notify_all();
+        m_pack_cv.notify_all();
+    }
+    for (auto& t : workers) if (t.joinable()) t.join();
+    workers.clear();
+    if (packer.joinable()) packer.join();
+    std::deque<std::shared_ptr<RecSession>> left;
+    {
+        std::lock_guard<std::mutex> l(m_mtx);
+        left.swap(ready);
+        pack_ready.clear();
+    }
+    for (auto& s : left) {
+        std::lock_guard<std::mutex> lq(s->m_q_mtx);
+        s->scheduled = false;
+        s->m_done_cv.notify_all();
+    }
+}
+
+$on_game(Exiting) {
+    EncodeService::get().shutdown();
+}
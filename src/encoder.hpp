@@ -0,0 +1,135 @@
+#pragma once
+#include <Geode/Geode.hpp>
+#include <eclipse.ffmpeg-api/include/events.hpp>
+#include "common/common.hpp"
+#include "common/frame_view.hpp"
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <memory>
+#include <vector>
+#include <filesystem>
+
+// axiom was here
+// i hate this project so much why did i start this, at least it has features now
+// one queued frame. empty px = repeat of the previous one, packed = frame_pack stream instead of raw BGRA
+struct QFrame {
+    std::vector<uint8_t> px;
+    uint64_t seq = 0;
+    bool packed = false;
+    // the packer has px out right now, the worker waits on m_pack_cv if it gets here first
+    bool packing = false;
+    // didnt shrink enough or no budget for it, stays raw
+    bool pack_skip = false;
+};
+
+struct RecSession : std::enable_shared_from_this<RecSession> {
+    ffmpeg::events::Recorder* rec = nullptr;
+    std::deque<QFrame> c_pixel_q;
+    std::vector<std::vector<uint8_t>> pool_frames;
+    std::mutex m_q_mtx;
+    std::mutex m_p_mtx;
+    std::condition_variable m_done_cv;
+    std::condition_variable m_pack_cv;
+    bool dead = false;
+    // true while the session sits in the service queue or a worker is on it, guarded by m_q_mtx
+    bool scheduled = false;
+    // raw buffers (pool + queue), and how many entries the queue takes. same thing unless frames get packed
+    int max_frames = 30;
+    int max_queue = 30;
+    // compress-frame-queue: entries past max_frames / 2 get packed on the service's packer thread
+    bool pack = false;
+    static constexpr int PACK_DEPTH = 8;
+    bool pack_pending = false;
+    uint64_t next_seq = 0;
+    int raw_queued = 0;
+    std::atomic<int> pack_frames{0};
+    std::atomic<int64_t> pack_in_bytes{0};
+    std::atomic<int64_t> pack_out_bytes{0};
+    std::atomic<int64_t> pack_us{0};
+    std::filesystem::path temp_file_p;
+    bool b_saved = false;
+    int fps = 30;
+    std::atomic<int> frames_written{0};
+    std::atomic<int> dup_frames{0};
+    // main thread only, counts every frame handed to the queue so events line up with video time
+    int frames_queued = 0;
+    std::vector<ClipEvent> events;
+    // worker keeps the last real frame so duplicates come through the queue as empty tokens
+    std::vector<uint8_t> last_frame;
+    // packed frames get unpacked in here, swapped with last_frame like a raw one
+    std::vector<uint8_t> unpack_buf;
+    // replay buffer mode, the worker rolls rec over to the next ring slot every seg_frames. 0 = one file per attempt
+    ffmpeg::RenderSettings cfg;
+    int seg_frames = 0;
+    // worker only (main thread once drained): frames that went through this segment, and the ones that made it into the file
+    int seg_ticks = 0;
+    int seg_written = 0;
+    bool seg_closed = false;
+    // every buffer in the session is this big, pool/queue/last_frame all count against the MemGovernor
+    int64_t frame_bytes = 0;
+    // what this session has charged the governor, given back as buffers get freed and the rest in the destructor
+    std::atomic<int64_t> charged_bytes{0};
+
+    // main thread only, duplicate detection for submit()
+    bool skip_dups = false;
+    bool has_last_hash = false;
+    uint64_t last_hash = 0;
+
+    // the capture's way in. copies the view once into a pooled buffer (converting to BGRA if needed), releases it and queues the buffer
+    // a duplicate of the last frame or no budget left queues a repeat instead. false if nothing new got queued
+    bool submit(FrameView const& v);
+    // pooled buffer, or a new one if the global budget has room. empty if neither, caller sends a repeat then
+    std::vector<uint8_t> take_frame();
+    // pool it again, unless the session is draining or the pool is full, then its freed and the bytes go back
+    void recycle_frame(std::vector<uint8_t>&& f);
+    // rough guess at what the encoder holds internally (swscale + lookahead), charged up front since we cant see it
+    void charge_encoder_estimate(int n_frames);
+    // false if the queue was full, the buffer goes back to the pool then
+    bool enqueue(std::vector<uint8_t>&& frame);
+    // encodes up to n frames, returns false once the queue is empty
+    bool encode_some(int n);
+    // packs queued raw frames past the threshold until there are none left, packer thread only
+    void pack_some();
+    void finish();
+    // hands the current file back to the ReplayRing with what got written into it
+    void close_segment();
+    void wait_drained();
+
+    ~RecSession();
+
+private:
+    void roll_segment();
+    void write_frame(std::vector<uint8_t> const& frame, bool dup);
+};
+
+// fixed set of encoder threads shared by every session, sessions just get queued up when they have frames
+// nothing gets created or joined on the reset path
+class EncodeService {
+public:
+    static EncodeService& get();
+
+    void schedule(std::shared_ptr<RecSession> s);
+    void schedule_pack(std::shared_ptr<RecSession> s);
+    void shutdown();
+
+    static constexpr int N_WORKERS = 2;
+    static constexpr int BATCH_FRAMES = 8;
+
+private:
+    EncodeService();
+    void run();
+    void run_packer();
+
+    std::deque<std::shared_ptr<RecSession>> ready;
+    std::mutex m_mtx;
+    std::condition_variable m_cv;
+    std::vector<std::thread> workers;
+    // one helper thread for frame packing, so a slow pack never holds up encoding
+    std::deque<std::shared_ptr<RecSession>> pack_ready;
+    std::condition_variable m_pack_cv;
+    std::thread packer;
+    bool stopping = false;
+};
@@ -0,0 +1,140 @@
+#include "frame_blend.hpp"
+
+#ifndef GL_RGBA16F
+#define GL_RGBA16F 0x881A
+#endif
+
+using namespace geode::prelude;
+
+// positions are already clip space, no matrices. rgb only, the recording has no alpha anyway
+static const char* s_blend_vsh = R"(
+attribute vec4 a_position;
+attribute vec2 a_texCoord;
+varying vec2 v_uv;
+void main() {
+    gl_Position = a_position;
+    v_uv = a_texCoord;
+}
+)";
+
+static const char* s_blend_fsh = R"(
+#ifdef GL_ES
+precision mediump float;
+#endif
+varying vec2 v_uv;
+uniform sampler2D u_tex;
+uniform float u_weight;
+void main() {
+    gl_FragColor = vec4(texture2D(u_tex, v_uv).rgb * u_weight, 1.0);
+}
+)";
+
+FrameBlender::~FrameBlender() {
+    destroy();
+    if (m_prog) { m_prog->release(); m_prog = nullptr; }
+}
+
+bool FrameBlender::setup(int w, int h) {
+    m_frames = 0;
+    m_dirty = true;
+    if (m_accum_fbo && m_w == w && m_h == h) return true;
+    destroy();
+
+    if (!m_prog) {
+        m_prog = new CCGLProgram();
+        m_prog->initWithVertexShaderByteArray(s_blend_vsh, s_blend_fsh);
+        m_prog->addAttribute(kCCAttributeNamePosition, kCCVertexAttrib_Position);
+        m_prog->addAttribute(kCCAttributeNameTexCoord, kCCVertexAttrib_TexCoords);
+        if (!m_prog->link()) {
+            log::warn("frame blending shader failed to link, blending off");
+            m_prog->release(); m_prog = nullptr;
+            return false;
+        }
+        m_prog->updateUniforms();
+        m_u_weight = m_prog->getUniformLocationForName("u_weight");
+        m_u_tex = m_prog->getUniformLocationForName("u_tex");
+    }
+
+    GLint prev_fbo = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prev_fbo);
+    glGenTextures(1, &m_accum_tex);
+    ccGLBindTexture2D(m_accum_tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, w, h, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glGenFramebuffers(1, &m_accum_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_accum_fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_accum_tex, 0);
+    bool ok = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, prev_fbo);
+    ccGLBindTexture2D(0);
+    if (!ok) {
+        log::warn("float render target not supported, frame blending off");
+        destroy();
+        return false;
+    }
+    m_w = w; m_h = h;
+    return true;
+}
+
+void FrameBlender::destroy() {
+    if (m_accum_fbo) { glDeleteFramebuffers(1, &m_accum_fbo); m_accum_fbo = 0; }
+    if (m_accum_tex) { ccGLDeleteTexture(m_accum_tex); m_accum_tex = 0; }
+    m_w = 0; m_h = 0; m_frames = 0;
+}
+
+// goes through the cocos state cache for program/texture/blend/attribs so the next cocos draw rebinds what it needs
+void FrameBlender::draw_quad(GLuint tex, float weight, bool additive) {
+    static const GLfloat verts[] = { -1.f, -1.f, 1.f, -1.f, -1.f, 1.f, 1.f, 1.f };
+    static const GLfloat uvs[] = { 0.f, 0.f, 1.f, 0.f, 0.f, 1.f, 1.f, 1.f };
+
+    GLint prev_vp[4];
+    glGetIntegerv(GL_VIEWPORT, prev_vp);
+    GLboolean had_blend = glIsEnabled(GL_BLEND);
+    glViewport(0, 0, m_w, m_h);
+
+    if (additive) {
+        glEnable(GL_BLEND);
+        ccGLBlendFunc(GL_ONE, GL_ONE);
+    } else {
+        glDisable(GL_BLEND);
+    }
+    m_prog->use();
+    m_prog->setUniformLocationWith1i(m_u_tex, 0);
+    m_prog->setUniformLocationWith1f(m_u_weight, weight);
+    ccGLBindTexture2D(tex);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    ccGLEnableVertexAttribs(kCCVertexAttribFlag_Position | kCCVertexAttribFlag_TexCoords);
+    glVertexAttribPointer(kCCVertexAttrib_Position, 2, GL_FLOAT, GL_FALSE, 0, verts);
+    glVertexAttribPointer(kCCVertexAttrib_TexCoords, 2, GL_FLOAT, GL_FALSE, 0, uvs);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    if (had_blend) glEnable(GL_BLEND); else glDisable(GL_BLEND);
+    glViewport(prev_vp[0], prev_vp[1], prev_vp[2], prev_vp[3]);
+}
+
+void FrameBlender::accumulate(GLuint src_tex) {
+    if (!ready()) return;
+    glBindFramebuffer(GL_FRAMEBUFFER, m_accum_fbo);
+    if (m_dirty) {
+        GLfloat prev_clear[4];
+        glGetFloatv(GL_COLOR_CLEAR_VALUE, prev_clear);
+        glClearColor(0.f, 0.f, 0.f, 0.f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glClearColor(prev_clear[0], prev_clear[1], prev_clear[2], prev_clear[3]);
+        m_dirty = false;
+    }
+    draw_quad(src_tex, 1.f, true);
+    m_frames++;
+}
+
+bool FrameBlender::resolve(GLuint dst_fbo) {
+    if (!ready() || m_frames == 0) return false;
+    glBindFramebuffer(GL_FRAMEBUFFER, dst_fbo);
+    draw_quad(m_accum_tex, 1.f / (float)m_frames, false);
+    m_frames = 0;
+    m_dirty = true;
+    return true;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <Geode/Geode.hpp>
+
+// motion blur for when the game renders faster than we record. every rendered frame inside the shutter gets added
+// into a float target on the gpu and the capture only reads back the average, so readback stays at the output fps
+class FrameBlender {
+public:
+    ~FrameBlender();
+
+    // false if the driver cant render to a float texture, capture just goes on without blending then
+    bool setup(int w, int h);
+    void destroy();
+    bool ready() const { return m_accum_fbo != 0; }
+    int frames() const { return m_frames; }
+
+    // adds a w x h texture into the accumulator
+    void accumulate(GLuint src_tex);
+    // writes the average into dst_fbo and starts over, false if nothing was added since the last one
+    bool resolve(GLuint dst_fbo);
+
+private:
+    void draw_quad(GLuint tex, float weight, bool additive);
+
+    GLuint m_accum_fbo = 0;
+    GLuint m_accum_tex = 0;
+    cocos2d::CCGLProgram* m_prog = nullptr;
+    GLint m_u_weight = -1;
+    GLint m_u_tex = -1;
+    int m_w = 0, m_h = 0;
+    int m_frames = 0;
+    bool m_dirty = false;
+};
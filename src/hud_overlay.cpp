@@ -0,0 +1,141 @@
+#include "hud_overlay.hpp"
+#include <algorithm>
+#include <cmath>
+
+using namespace geode::prelude;
+
+static const char* s_hud_vsh = R"(
+attribute vec4 a_position;
+attribute vec2 a_texCoord;
+varying vec2 v_uv;
+void main() {
+    gl_Position = a_position;
+    v_uv = a_texCoord;
+}
+)";
+
+static const char* s_hud_fsh = R"(
+#ifdef GL_ES
+precision mediump float;
+#endif
+varying vec2 v_uv;
+uniform sampler2D u_tex;
+void main() {
+    gl_FragColor = texture2D(u_tex, v_uv);
+}
+)";
+
+HudOverlay::~HudOverlay() {
+    destroy();
+    if (m_prog) { m_prog->release(); m_prog = nullptr; }
+    if (m_label) { m_label->release(); m_label = nullptr; }
+    if (m_box) { m_box->release(); m_box = nullptr; }
+}
+
+bool HudOverlay::setup(int rec_w, int rec_h) {
+    m_text.clear();
+    m_used_w = 0; m_used_h = 0;
+    if (m_rt && m_rec_w == rec_w && m_rec_h == rec_h) return true;
+    destroy();
+
+    if (!m_prog) {
+        m_prog = new CCGLProgram();
+        m_prog->initWithVertexShaderByteArray(s_hud_vsh, s_hud_fsh);
+        m_prog->addAttribute(kCCAttributeNamePosition, kCCVertexAttrib_Position);
+        m_prog->addAttribute(kCCAttributeNameTexCoord, kCCVertexAttrib_TexCoords);
+        if (!m_prog->link()) {
+            log::warn("hud overlay shader failed to link, overlay off");
+            m_prog->release(); m_prog = nullptr;
+            return false;
+        }
+        m_prog->updateUniforms();
+        m_u_tex = m_prog->getUniformLocationForName("u_tex");
+    }
+    if (!m_label) {
+        m_label = CCLabelBMFont::create("", "bigFont.fnt");
+        m_label->setAnchorPoint({0, 0});
+        m_label->retain();
+    }
+    if (!m_box) {
+        m_box = CCLayerColor::create({0, 0, 0, 140});
+        m_box->retain();
+    }
+
+    // one text line plus padding, as wide as the frame. render texture sizes are in points
+    float csf = CCDirector::get()->getContentScaleFactor();
+    float line_px = std::max(12.f, rec_h * LINE_FRAC);
+    int box_h = (int)std::ceil(line_px * 1.5f);
+    m_rt = CCRenderTexture::create((int)std::ceil(rec_w / csf), (int)std::ceil(box_h / csf), kCCTexture2DPixelFormat_RGBA8888);
+    if (!m_rt) return false;
+    m_rt->retain();
+    m_rec_w = rec_w; m_rec_h = rec_h;
+    m_margin = (int)(line_px * 0.5f);
+    return true;
+}
+
+void HudOverlay::destroy() {
+    if (m_rt) { m_rt->release(); m_rt = nullptr; }
+    m_rec_w = 0; m_rec_h = 0;
+    m_used_w = 0; m_used_h = 0;
+    m_text.clear();
+}
+
+void HudOverlay::set_text(std::string const& txt) {
+    if (!ready() || txt == m_text) return;
+    m_text = txt;
+    float csf = CCDirector::get()->getContentScaleFactor();
+    float line_px = std::max(12.f, m_rec_h * LINE_FRAC);
+    float pad_px = line_px * 0.25f;
+
+    m_label->setString(txt.c_str());
+    m_label->setScale(1.f);
+    float raw_h = m_label->getContentSize().height;
+    m_label->setScale(raw_h > 0 ? (line_px / csf) / raw_h : 1.f);
+    m_label->setPosition({pad_px / csf, pad_px / csf});
+
+    float text_w_px = m_label->getContentSize().width * m_label->getScale() * csf;
+    m_used_w = std::min(m_rec_w - m_margin * 2, (int)std::ceil(text_w_px + pad_px * 2));
+    m_used_h = (int)std::ceil(line_px + pad_px * 2);
+    m_box->setContentSize({m_used_w / csf, m_used_h / csf});
+
+    m_rt->beginWithClear(0.f, 0.f, 0.f, 0.f);
+    m_box->visit();
+    m_label->visit();
+    m_rt->end();
+}
+
+// cocos state cache for program/texture/blend/attribs like the frame blender, so the next cocos draw rebinds what it needs
+void HudOverlay::draw(GLuint dst_fbo) {
+    if (!ready() || m_used_w <= 0) return;
+    CCTexture2D* tex = m_rt->getSprite()->getTexture();
+    float tex_w = (float)tex->getPixelsWide(), tex_h = (float)tex->getPixelsHigh();
+    if (tex_w <= 0 || tex_h <= 0) return;
+
+    // render texture content sits in the bottom left of its (maybe pot) texture, gl orientation like the capture target
+    float u1 = m_used_w / tex_w, v1 = m_used_h / tex_h;
+    float x0 = (float)m_margin / m_rec_w * 2.f - 1.f, y0 = (float)m_margin / m_rec_h * 2.f - 1.f;
+    float x1 = (float)(m_margin + m_used_w) / m_rec_w * 2.f - 1.f, y1 = (float)(m_margin + m_used_h) / m_rec_h * 2.f - 1.f;
+    GLfloat verts[] = { x0, y0, x1, y0, x0, y1, x1, y1 };
+    GLfloat uvs[] = { 0.f, 0.f, u1, 0.f, 0.f, v1, u1, v1 };
+
+    GLint prev_vp[4];
+    glGetIntegerv(GL_VIEWPORT, prev_vp);
+    GLboolean had_blend = glIsEnabled(GL_BLEND);
+    glBindFramebuffer(GL_FRAMEBUFFER, dst_fbo);
+    glViewport(0, 0, m_rec_w, m_rec_h);
+
+    // the render texture comes out premultiplied
+    glEnable(GL_BLEND);
+    ccGLBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    m_prog->use();
+    m_prog->setUniformLocationWith1i(m_u_tex, 0);
+    ccGLBindTexture2D(tex->getName());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    ccGLEnableVertexAttribs(kCCVertexAttribFlag_Position | kCCVertexAttribFlag_TexCoords);
+    glVertexAttribPointer(kCCVertexAttrib_Position, 2, GL_FLOAT, GL_FALSE, 0, verts);
+    glVertexAttribPointer(kCCVertexAttrib_TexCoords, 2, GL_FLOAT, GL_FALSE, 0, uvs);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    if (had_blend) glEnable(GL_BLEND); else glDisable(GL_BLEND);
+    glViewport(prev_vp[0], prev_vp[1], prev_vp[2], prev_vp[3]);
+}
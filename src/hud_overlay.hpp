@@ -0,0 +1,35 @@
+#pragma once
+#include <Geode/Geode.hpp>
+#include <string>
+
+// text burned into the recording only. the label gets rendered into a cached texture when the text changes,
+// every captured frame after that is one alpha blended quad into the capture target, nothing on screen and nothing on the cpu side
+class HudOverlay {
+public:
+    ~HudOverlay();
+
+    // recording size, the text is sized against the video not the window
+    bool setup(int rec_w, int rec_h);
+    void destroy();
+    bool ready() const { return m_rt != nullptr; }
+
+    // re-renders the cached texture if txt differs from what it has. main thread, not inside a draw
+    void set_text(std::string const& txt);
+    // blends the cached text into the bottom left of dst_fbo
+    void draw(GLuint dst_fbo);
+
+    // one line of text is this much of the frame height
+    static constexpr float LINE_FRAC = 0.035f;
+
+private:
+    cocos2d::CCRenderTexture* m_rt = nullptr;
+    cocos2d::CCLabelBMFont* m_label = nullptr;
+    cocos2d::CCLayerColor* m_box = nullptr;
+    cocos2d::CCGLProgram* m_prog = nullptr;
+    GLint m_u_tex = -1;
+    std::string m_text;
+    int m_rec_w = 0, m_rec_h = 0;
+    // what of the render texture the last text used, in pixels
+    int m_used_w = 0, m_used_h = 0;
+    int m_margin = 0;
+};
@@ -4,9 +4,11 @@
 #include <string>
 #include <filesystem>
 #include <cstdint>
+#include <vector>
+#include "common/common.hpp"
 
 std::string get_codec();
 int64_t get_total_ram_mb();
-void save_clip(std::filesystem::path srcPath, std::string sLvlName, int nAttempts);
+std::filesystem::path get_ffmpeg_path();
 
 #endif
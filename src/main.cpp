@@ -9,9 +9,17 @@
 #include <eclipse.ffmpeg-api/include/events.hpp>
 #include <Geode/utils/string.hpp>
 #include "common/common.hpp"
+#include "common/temp_pool.hpp"
+#include "common/mem_governor.hpp"
+#include "common/capture_geom.hpp"
+#include "common/replay_ring.hpp"
 #include "win/win.hpp"
 #include "mac/mac.hpp"
 #include "ui.hpp"
+#include "encoder.hpp"
+#include "frame_blend.hpp"
+#include "hud_overlay.hpp"
+#include "capture.hpp"
 #include <atomic>
 #include <queue>
 #include <mutex>
@@ -21,61 +29,61 @@
 #include <cstdlib>
 #include <ctime>
 
-#ifndef GL_MAP_READ_BIT
-#define GL_MAP_READ_BIT 0x0001
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
+#endif
+#ifndef GEODE_IS_ANDROID
+#define ECHOCLIP_GPU_TIMERS
 #endif
 
 using namespace geode::prelude;
 namespace fs = std::filesystem;
 
-// axiom was here
-// i hate this project so much why did i start this, at least it has features now
-struct RecSession {
-    ffmpeg::events::Recorder* rec = nullptr;
-    std::thread* p_worker_thread = nullptr;
-    std::queue<std::vector<uint8_t>> c_pixel_q;
-    std::vector<std::vector<uint8_t>> pool_frames;
-    std::mutex m_q_mtx;
-    std::mutex m_p_mtx;
-    std::condition_variable m_cv;
-    bool dead = false;
-    int max_frames = 30;
-    fs::path temp_file_p;
-    bool b_saved = false;
-    int fps = 30;
-    std::atomic<int> frames_written{0};
-
-    ~RecSession() {
-        dead = true; m_cv.notify_all();
-        if (p_worker_thread) {
-            if (p_worker_thread->joinable()) {
-                if (std::this_thread::get_id() == p_worker_thread->get_id()) p_worker_thread->detach();
-                else p_worker_thread->join();
-            }
-            delete p_worker_thread;
-        }
-        if (rec) { rec->stop(); delete rec; }
+static bool s_perf_stats = false;
 
-        if (!b_saved && !temp_file_p.empty()) {
-            std::error_code ec;
-            fs::remove(temp_file_p, ec);
-        }
-    }
+enum class CaptureClock {
+    Wall,
+    GameTime,
+    Render,
 };
 
-void finalize_and_save(std::shared_ptr<RecSession> s, std::string lvl, int att) {
+static CaptureClock parse_capture_clock(std::string const& s) {
+    if (s == "game-time") return CaptureClock::GameTime;
+    if (s == "render") return CaptureClock::Render;
+    return CaptureClock::Wall;
+}
+
+// whole_ring only matters in replay buffer mode, the hotkey saves all of it, new best / complete just the attempt
+void finalize_and_save(std::shared_ptr<RecSession> s, std::string lvl, int att, bool whole_ring = false) {
     if (!s || s->temp_file_p.empty()) return;
 
-    s->dead = true;
-    s->m_cv.notify_all();
-    if (s->p_worker_thread && s->p_worker_thread->joinable())
-        s->p_worker_thread->join();
+    SaveTiming timing;
+    timing.t_request = get_time_val();
+    s->finish();
+    s->wait_drained();
+    timing.t_drained = get_time_val();
+
+    // replay buffer, close the segment thats recording and cut the range out of the ring instead of saving the attempt
+    if (s->seg_frames > 0) {
+        if (s->rec) { s->rec->stop(); delete s->rec; s->rec = nullptr; }
+        s->close_segment();
+        timing.t_stopped = get_time_val();
+        double from_s = whole_ring ? ReplayRing::get().minutes() * 60.0 : (double)s->frames_written.load() / (double)std::max(1, s->fps);
+        Notification::create("Clipping...", CCSprite::createWithSpriteFrameName("GJ_completesIcon_001.png"))->show();
+        save_replay(lvl, att, from_s, 0.0, ReplayRing::get().newest_seq(), timing);
+        return;
+    }
 
     if (s->rec) {
         s->rec->stop();
         delete s->rec;
         s->rec = nullptr;
+        s->temp_file_p = TempPool::get().take(s->temp_file_p);
+        std::error_code ec_sz;
+        geode::log::debug("finalize {}: {} bytes", geode::utils::string::pathToString(s->temp_file_p.filename()), (long long)fs::file_size(s->temp_file_p, ec_sz));
+        MemGovernor::get().log_usage("clip saved");
     }
+    timing.t_stopped = get_time_val();
 
     std::error_code ec;
     if (!fs::exists(s->temp_file_p, ec)) {
@@ -89,7 +97,9 @@ void finalize_and_save(std::shared_ptr<RecSession> s, std::string lvl, int att)
     int fwritten = s->frames_written.load();
     int fps = s->fps > 0 ? s->fps : 30;
     double dur = (double)fwritten / (double)fps;
-    save_clip(s->temp_file_p, lvl, att);
+    int out_w = 0, out_h = 0;
+    get_target_rec_size(out_w, out_h);
+    save_clip(s->temp_file_p, lvl, att, dur, out_w, out_h, (int)Mod::get()->getSettingValue<int64_t>("target-fps"), std::move(s->events), timing);
 }
 
 class $modify(MyBaseGameLayer, GJBaseGameLayer) {
@@ -101,10 +111,12 @@ class $modify(MyBaseGameLayer, GJBaseGameLayer) {
         std::string s_lvl_str;
         int n_att_count = 1, best_percent = 0;
         float f_timer_val = 0;
+        // where the capture clock was at the last update, < 0 = start over from the next one
+        CaptureClock clock = CaptureClock::Wall;
+        double last_clock = -1;
 
-        GLuint pbo_bufer[3] = {0, 0, 0};
-        GLsync fences_sync_ptr[3] = {0, 0, 0};
-        int write_idx = 0;
+        // made on the first captured frame, needs the context to pick desktop gl or gles
+        std::unique_ptr<CaptureBackend> capture;
 
         int n_pushed_frames = 0;
         bool b_setup_done = false;
@@ -112,19 +124,60 @@ class $modify(MyBaseGameLayer, GJBaseGameLayer) {
 
         GLuint downscale_fbo = 0;
         GLuint downscale_tex = 0;
+        CaptureAspect aspect_mode = CaptureAspect::Native;
+
+        // frame blending, b_accum_this_frame marks rendered frames inside the shutter that arent a capture tick
+        FrameBlender blender;
+        bool blend = false;
+        float shutter = 0.5f;
+        bool b_accum_this_frame = false;
+
+        // text burned into the video only, hud_tpl is the setting with the {tokens} still in
+        HudOverlay hud;
+        bool hud_on = false;
+        std::string hud_tpl;
 
         float gap_cache = 0.01666f;
         bool clip_new_best = false;
         int current_rec_att = 1;
 
+        bool paused = false;
+
+        // capture cost, gpu timer queries come back a couple frames late so theres one per pbo slot
+        GLuint gpu_q[3] = {0, 0, 0};
+        bool gpu_q_live[3] = {false, false, false};
+        double win_cost_ms = 0;
+        int win_frames = 0;
+        int skip_factor = 1;
+        // readback scale the budget falls back to after thinning, per level so a slow stretch doesnt follow every recording after it
+        float auto_scale = 1.f;
+        int under_windows = 0;
+        // output ticks so far, the next one's pts. a capture keeps the pts of its tick through the pbo ring
+        // so repeats (thinned or skipped ticks) get filled in by submit() in order, not ahead of the frame before them
+        int64_t ticks = 0;
+        int64_t capture_pts = -1;
+        int64_t slot_pts[CaptureBackend::N_SLOTS] = {-1, -1, -1};
+        float budget_ms = 0.f;
+
         ~Fields() {
-            if (session) { session->dead = true; session->m_cv.notify_all(); }
-            for (int i = 0; i < 3; i++) if (fences_sync_ptr[i]) { glDeleteSync(fences_sync_ptr[i]); fences_sync_ptr[i] = 0; }
+            if (session) session->finish();
+#ifdef ECHOCLIP_GPU_TIMERS
+            if (gpu_q[0]) glDeleteQueries(3, gpu_q);
+#endif
+            capture.reset();
+            hud.destroy();
             if (downscale_fbo) glDeleteFramebuffers(1, &downscale_fbo);
             if (downscale_tex) glDeleteTextures(1, &downscale_tex);
         }
     };
 
+    void mark_event(std::string kind, int value) {
+        Fields* f = m_fields.self();
+        if (!f->active || !f->session) return;
+        std::shared_ptr<RecSession> s = f->session;
+        s->events.push_back({(double)f->ticks / (double)std::max(1, s->fps), std::move(kind), value});
+    }
+
     void trigger_clip() {
         Fields* f = m_fields.self();
         if (!Mod::get()->getSettingValue<bool>("enabled")) return;
@@ -132,9 +185,10 @@ class $modify(MyBaseGameLayer, GJBaseGameLayer) {
             geode::log::warn("trigger_clip called but not active");
             return;
         }
+        mark_event("hotkey", 0);
         std::shared_ptr<RecSession> s = kill_rec();
         if (s) {
-            finalize_and_save(s, f->s_lvl_str, f->current_rec_att);
+            finalize_and_save(s, f->s_lvl_str, f->current_rec_att, true);
             int w = 0, h = 0;
             get_target_rec_size(w, h);
             start_rec(w, h);
@@ -147,22 +201,44 @@ class $modify(MyBaseGameLayer, GJBaseGameLayer) {
         if (m_isPracticeMode && !Mod::get()->getSettingValue<bool>("record-practice")) return;
         if (m_isTestMode && !Mod::get()->getSettingValue<bool>("record-startpos")) return;
 
+        m_fields->budget_ms = (float)Mod::get()->getSettingValue<double>("capture-budget-ms");
+        // turned off since the last attempt, nothing thins or shrinks the capture anymore
+        if (m_fields->budget_ms <= 0) { m_fields->skip_factor = 1; m_fields->auto_scale = 1.f; m_fields->under_windows = 0; }
+
+        if (m_fields->auto_scale < 1.f) {
+            int align = Mod::get()->getSettingValue<bool>("align-16") ? 16 : 2;
+            recW = align_dim((int)(recW * m_fields->auto_scale), align);
+            recH = align_dim((int)(recH * m_fields->auto_scale), align);
+        }
+
         int sz_bytes = recW * recH * 4;
 
         m_fields->gap_cache = 1.f / (float)Mod::get()->getSettingValue<int64_t>("target-fps");
+        m_fields->clock = parse_capture_clock(Mod::get()->getSettingValue<std::string>("capture-clock"));
+        m_fields->last_clock = -1;
         m_fields->clip_new_best = Mod::get()->getSettingValue<bool>("clip-on-new-best");
+        m_fields->aspect_mode = parse_capture_aspect(Mod::get()->getSettingValue<std::string>("capture-aspect"));
+        m_fields->win_cost_ms = 0; m_fields->win_frames = 0; m_fields->ticks = 0; m_fields->capture_pts = -1;
 
         int64_t ram_mb = Mod::get()->getSettingValue<int64_t>("max-ram-usage");
         int64_t sys_ram = get_total_ram_mb();
         if (ram_mb > (sys_ram * 8 / 10)) ram_mb = sys_ram * 8 / 10;
         if (ram_mb > 4096) ram_mb = 4096;
+        // the limit covers every session at once, the old one draining counts against the new one
+        MemGovernor::get().set_limit(ram_mb * 1024 * 1024);
 
         int max_f = sz_bytes > 0 ? std::max(10, (int)((ram_mb * 1024 * 1024) / sz_bytes)) : 30;
 
-        std::error_code ec;
-        fs::path d = Mod::get()->getSaveDir() / "temp";
-        fs::create_directories(d, ec);
-        fs::path temp_p = d / fmt::format("r_{}_{}.mp4", (int)get_time_val(), rand() % 100000);
+        // mkv writes its clusters as it goes, so a temp file is still playable if the game dies before rec->stop()
+        std::string ext = Mod::get()->getSettingValue<std::string>("recording-container") == "mp4" ? "mp4" : "mkv";
+        ReplayRing::get().configure((int)Mod::get()->getSettingValue<int64_t>("replay-buffer-minutes"),
+            Mod::get()->getSettingValue<int64_t>("replay-buffer-max-mb"), ext);
+        bool ring = ReplayRing::get().enabled();
+        fs::path temp_p = ring ? ReplayRing::get().begin_segment() : TempPool::get().acquire(ext);
+        if (temp_p.empty()) {
+            geode::log::warn("replay buffer has no free segment, skipping this attempt");
+            return;
+        }
 
         std::vector<std::string> codecs_to_try;
         std::string preferred = get_codec();
@@ -171,6 +247,7 @@ class $modify(MyBaseGameLayer, GJBaseGameLayer) {
 
         ffmpeg::events::Recorder* p_rec = nullptr;
         std::string working_codec = "";
+        ffmpeg::RenderSettings working_cfg;
 
         for (std::string const& codec : codecs_to_try) {
             ffmpeg::RenderSettings config;
@@ -187,6 +264,7 @@ class $modify(MyBaseGameLayer, GJBaseGameLayer) {
             if (res.isOk()) {
                 p_rec = candidate;
                 working_codec = codec;
+                working_cfg = config;
                 break;
             }
             geode::log::warn("codec {} failed to init, trying next", codec);
@@ -195,6 +273,8 @@ class $modify(MyBaseGameLayer, GJBaseGameLayer) {
 
         if (!p_rec) {
             geode::log::error("all codecs failed, recording disabled for this attempt");
+            if (ring) ReplayRing::get().end_segment(temp_p, 0, recW, recH, 0, "");
+            else TempPool::get().release(temp_p);
             return;
         }
 
@@ -205,12 +285,24 @@ class $modify(MyBaseGameLayer, GJBaseGameLayer) {
         }
 
         std::shared_ptr<RecSession> s = std::make_shared<RecSession>();
-        s->rec = p_rec; s->max_frames = max_f; s->temp_file_p = temp_p;
+        s->rec = p_rec; s->max_frames = max_f; s->max_queue = max_f; s->temp_file_p = temp_p;
+        // half the budget stays raw, the backlog past that is packed so the same ram holds a lot more frames
+        if (Mod::get()->getSettingValue<bool>("compress-frame-queue")) {
+            s->pack = true;
+            s->max_frames = std::max(10, max_f / 2);
+            s->max_queue = s->max_frames * RecSession::PACK_DEPTH;
+        }
+        s->frame_bytes = sz_bytes;
+        s->skip_dups = Mod::get()->getSettingValue<bool>("skip-duplicate-frames");
+        s->charge_encoder_estimate(working_codec == "libx264" ? 8 : 3);
     s->fps = (int)Mod::get()->getSettingValue<int64_t>("target-fps");
+        s->cfg = working_cfg;
+        if (ring) s->seg_frames = ReplayRing::SEG_S * std::max(1, s->fps);
         m_fields->session = s;
         m_fields->nW = recW; m_fields->nH = recH;
         m_fields->active = true; m_fields->n_pushed_frames = 0;
         Fields* f = m_fields.self();
+        mark_event("attempt", f->current_rec_att);
 
         if (f->downscale_fbo && f->prev_downscale_w == recW && f->prev_downscale_h == recH) {
         } else {
@@ -231,31 +323,24 @@ class $modify(MyBaseGameLayer, GJBaseGameLayer) {
             f->prev_downscale_h = recH;
         }
 
+        f->blend = Mod::get()->getSettingValue<bool>("frame-blending") && f->blender.setup(recW, recH);
+        f->shutter = (float)Mod::get()->getSettingValue<int64_t>("shutter-angle") / 360.f;
+        f->b_accum_this_frame = false;
+
+        f->hud_on = Mod::get()->getSettingValue<bool>("hud-overlay") && f->hud.setup(recW, recH);
+        f->hud_tpl = Mod::get()->getSettingValue<std::string>("hud-text");
+
         {
             std::lock_guard<std::mutex> l(s->m_p_mtx);
-            s->pool_frames.clear();
             int pre = std::min(s->max_frames, 60);
             if (s->max_frames > 200) pre = std::max(pre, s->max_frames / 4);
-            for (int i = 0; i < pre; i++) s->pool_frames.push_back(std::vector<uint8_t>(sz_bytes));
+            // whatever a draining session still holds comes out of this, the rest gets allocated as frames come in
+            for (int i = 0; i < pre && MemGovernor::get().try_charge(sz_bytes); i++) {
+                s->pool_frames.push_back(std::vector<uint8_t>(sz_bytes));
+                s->charged_bytes.fetch_add(sz_bytes);
+            }
         }
 
-        s->p_worker_thread = new std::thread([s]() {
-            while (true) {
-                std::vector<uint8_t> c_pixel;
-                {
-                    std::unique_lock<std::mutex> lk(s->m_q_mtx);
-                    s->m_cv.wait(lk, [s] { return s->dead || !s->c_pixel_q.empty(); });
-                    if (s->dead && s->c_pixel_q.empty()) break;
-                    c_pixel = std::move(s->c_pixel_q.front()); s->c_pixel_q.pop();
-                }
-                if (s->rec->writeFrame(c_pixel).isOk()) s->frames_written.fetch_add(1);
-                std::lock_guard<std::mutex> l(s->m_p_mtx);
-                std::lock_guard<std::mutex> lq(s->m_q_mtx);
-                if ((int)(s->pool_frames.size() + s->c_pixel_q.size()) < s->max_frames) {
-                    s->pool_frames.push_back(std::move(c_pixel));
-                }
-            }
-        });
         if (m_fields->b_setup_done) cleanup_gl();
     }
 
@@ -264,35 +349,141 @@ class $modify(MyBaseGameLayer, GJBaseGameLayer) {
         m_fields->active = false;
         std::shared_ptr<RecSession> s = m_fields->session;
         m_fields->session = nullptr;
-        s->dead = true; s->m_cv.notify_all();
+        // repeats past the last frame that made it out of the pbos, so the clip runs as long as the attempt did
+        while (s->frames_queued < m_fields->ticks && s->enqueue(std::vector<uint8_t>())) {}
+        s->finish();
         return s;
     }
 
     void cleanup_gl() {
         if (!m_fields->b_setup_done) return;
-        glDeleteBuffers(3, m_fields->pbo_bufer);
-        for (int i = 0; i < 3; i++) if (m_fields->fences_sync_ptr[i]) { glDeleteSync(m_fields->fences_sync_ptr[i]); m_fields->fences_sync_ptr[i] = 0; }
+        if (m_fields->capture) m_fields->capture->destroy();
+#ifdef ECHOCLIP_GPU_TIMERS
+        if (m_fields->gpu_q[0]) glDeleteQueries(3, m_fields->gpu_q);
+        for (int i = 0; i < 3; i++) { m_fields->gpu_q[i] = 0; m_fields->gpu_q_live[i] = false; }
+#endif
         m_fields->b_setup_done = false;
     }
 
     void update(float dt) {
         GJBaseGameLayer::update(dt);
         Fields* f = m_fields.self();
-        if (!f->active || !f->session) return;
+        if (!f->active || !f->session || f->paused) return;
         std::shared_ptr<RecSession> s = f->session;
 
-        f->f_timer_val += dt;
+        f->f_timer_val += capture_clock_step(dt);
         while (f->f_timer_val >= f->gap_cache) {
             f->f_timer_val -= f->gap_cache;
+            int64_t tick = f->ticks++;
+            // thinned out by the capture budget, the next captured frame's pts leaves a gap that submit() fills with repeats
+            if (f->skip_factor > 1 && tick % f->skip_factor != 0) continue;
+            // clock moved more than one frame since the last render, only one capture can happen, it goes out as the latest tick
             f->b_capture_this_frame = true;
+            f->capture_pts = tick;
             std::lock_guard<std::mutex> l(s->m_q_mtx);
-            if ((int)s->c_pixel_q.size() > (int)(s->max_frames * 0.8)) f->b_capture_this_frame = false;
+            if ((int)s->c_pixel_q.size() > (int)(s->max_queue * 0.8)) f->b_capture_this_frame = false;
+        }
+        // shutter is the tail end of each output interval, 360 blends every frame, 180 the second half
+        if (f->blend) f->b_accum_this_frame = f->f_timer_val >= f->gap_cache * (1.f - f->shutter);
+        // only redrawn into its texture when the text actually changes, so about once a second for the timestamp
+        if (f->hud_on && f->b_capture_this_frame) f->hud.set_text(hud_text());
+    }
+
+    // the hud template with the tokens filled in, time is where this frame lands in the video
+    std::string hud_text() {
+        Fields* f = m_fields.self();
+        std::shared_ptr<RecSession> s = f->session;
+        int pct = 0;
+        if (auto pl = typeinfo_cast<PlayLayer*>(static_cast<GJBaseGameLayer*>(this))) pct = (int)pl->getCurrentPercent();
+        int secs = (int)(std::max<int64_t>(0, f->capture_pts) / std::max(1, s->fps));
+        std::string txt = f->hud_tpl;
+        auto sub = [&txt](std::string const& key, std::string const& val) {
+            for (size_t at = txt.find(key); at != std::string::npos; at = txt.find(key, at + val.size()))
+                txt.replace(at, key.size(), val);
+        };
+        sub("{level}", f->s_lvl_str);
+        sub("{attempt}", std::to_string(f->current_rec_att));
+        sub("{percent}", std::to_string(pct));
+        sub("{best}", std::to_string(f->best_percent));
+        sub("{time}", fmt::format("{}:{:02}", secs / 60, secs % 60));
+        return txt;
+    }
+
+    // how far the capture clock moved this update, in seconds of output video
+    float capture_clock_step(float dt) {
+        Fields* f = m_fields.self();
+        double now = 0;
+        switch (f->clock) {
+            // one output frame per rendered frame, however long it actually took
+            case CaptureClock::Render: return f->gap_cache;
+            // speed mods scale dt (or skip it entirely with physics bypass), the level timer is what the run looks like
+            case CaptureClock::GameTime: now = m_gameState.m_levelTime; break;
+            default: now = get_time_val(); break;
+        }
+        double step = f->last_clock >= 0 ? now - f->last_clock : 0;
+        f->last_clock = now;
+        // level timer went backwards (checkpoint) or the clock jumped after a hitch, dont dump seconds of repeats in
+        if (step < 0) step = 0;
+        if (step > 0.25) step = f->gap_cache;
+        return (float)step;
+    }
+
+    // called once per rendered frame, cost is whatever the capture path spent (cpu + gpu) averaged over every frame in the window
+    void check_capture_budget() {
+        Fields* f = m_fields.self();
+#ifdef ECHOCLIP_GPU_TIMERS
+        for (int i = 0; i < 3; i++) {
+            if (!f->gpu_q_live[i]) continue;
+            GLuint avail = 0;
+            glGetQueryObjectuiv(f->gpu_q[i], GL_QUERY_RESULT_AVAILABLE, &avail);
+            if (!avail) continue;
+            GLuint ns = 0;
+            glGetQueryObjectuiv(f->gpu_q[i], GL_QUERY_RESULT, &ns);
+            f->win_cost_ms += (double)ns / 1e6;
+            f->gpu_q_live[i] = false;
+        }
+#endif
+        if (++f->win_frames < 120) return;
+        double per_frame = f->win_cost_ms / (double)f->win_frames;
+        f->win_cost_ms = 0; f->win_frames = 0;
+        if (f->budget_ms <= 0) return;
+
+        if (per_frame > f->budget_ms) {
+            f->under_windows = 0;
+            if (f->skip_factor < 4) {
+                f->skip_factor++;
+                geode::log::info("capture cost {:.2f}ms/frame over {:.2f}ms budget, capturing every {} ticks", per_frame, f->budget_ms, f->skip_factor);
+            } else if (f->auto_scale > 0.5f) {
+                f->auto_scale -= 0.25f;
+                geode::log::info("capture cost {:.2f}ms/frame still over budget, readback scale {:.2f} from next attempt", per_frame, f->auto_scale);
+                Notification::create(fmt::format("Capture too slow, recording at {}% size", (int)(f->auto_scale * 100.f)),
+                    CCSprite::createWithSpriteFrameName("GJ_infoIcon_001.png"))->show();
+            }
+        } else if (per_frame < f->budget_ms * 0.4) {
+            if (f->skip_factor > 1) {
+                f->skip_factor--;
+                geode::log::info("capture cost {:.2f}ms/frame, back to every {} ticks", per_frame, f->skip_factor);
+            } else if (f->auto_scale < 1.f && ++f->under_windows >= 10) {
+                // ~20s well under budget. one 0.25 step is at most 2.25x the pixels, still under the budget from 0.4 so it doesnt bounce
+                f->under_windows = 0;
+                f->auto_scale = std::min(1.f, f->auto_scale + 0.25f);
+                geode::log::info("capture cost {:.2f}ms/frame, readback scale back up to {:.2f} from next attempt", per_frame, f->auto_scale);
+            }
+        } else {
+            f->under_windows = 0;
         }
     }
 };
 
 $execute {
-    cleanup_temp_folder();
+    note_main_thread();
+    set_thread_priority_level(parse_thread_priority(Mod::get()->getSettingValue<std::string>("thread-priority")));
+    listenForSettingChanges<std::string>("thread-priority", [](std::string value) {
+        set_thread_priority_level(parse_thread_priority(value));
+    });
+    s_perf_stats = Mod::get()->getSettingValue<bool>("perf-stats");
+    listenForSettingChanges<bool>("perf-stats", [](bool value) { s_perf_stats = value; });
+    run_startup_housekeeping();
     listenForKeybindSettingPresses("clip-keybind", [](geode::Keybind const&, bool down, bool repeat, double) {
         if (down && !repeat) {
             if (Mod::get()->getSettingValue<bool>("enabled")) {
@@ -304,100 +495,129 @@ $execute {
     });
 }
 
+static CaptureBackend* get_capture(MyBaseGameLayer::Fields* f, int winW, int winH) {
+    if (!f->capture) {
+        char const* ver = (char const*)glGetString(GL_VERSION);
+        f->capture = make_capture_backend(ver);
+        geode::log::info("capture backend: {} ({})", f->capture->name(), ver ? ver : "?");
+    }
+    f->capture->begin_frame(winW, winH);
+    return f->capture.get();
+}
+
+// mac retina lies in getFrameSize, ask GL directly so blit src is real pixels
+static void get_window_px(int& winW, int& winH) {
+    GLint vp[4] = {0, 0, 0, 0};
+    glGetIntegerv(GL_VIEWPORT, vp);
+    winW = vp[2];
+    winH = vp[3];
+    if (winW <= 0 || winH <= 0) {
+        CCSize fs2 = CCDirector::get()->getOpenGLView()->getFrameSize();
+        winW = (int)fs2.width; winH = (int)fs2.height;
+    }
+#ifdef GEODE_IS_MACOS
+    // bro retina displays are FUCKED the viewport is in POINTS not PIXELS
+    // only reason i added macos support is more damn downloads, regret already
+    extern float get_macos_backing_scale();
+    float scale = get_macos_backing_scale();
+    winW = (int)(winW * scale);
+    winH = (int)(winH * scale);
+#endif
+}
+
 class $modify(MyCCEGLView, CCEGLView) {
     void swapBuffers() {
         auto layer = GJBaseGameLayer::get();
+        if (layer && s_perf_stats) {
+            static double t_prev_swap = 0;
+            double now = get_time_val();
+            if (t_prev_swap > 0) record_frame_time((now - t_prev_swap) * 1000.0, static_cast<MyBaseGameLayer*>(layer)->m_fields->active);
+            t_prev_swap = now;
+        }
         if (layer) {
             MyBaseGameLayer::Fields* f = static_cast<MyBaseGameLayer*>(layer)->m_fields.self();
-            if (f->active && f->session && f->b_capture_this_frame) {
+            if (f->active && f->session && f->blend && f->b_accum_this_frame && !f->b_capture_this_frame && !f->paused) {
+                // in between frame, goes into the blend on the gpu and nothing gets read back
+                double t_cpu_start = get_time_val();
+                f->b_accum_this_frame = false;
+                int winW = 0, winH = 0;
+                get_window_px(winW, winH);
+                CaptureBackend* cap = get_capture(f, winW, winH);
+                if (cap->blit_window(f->downscale_fbo, compute_capture_geom(winW, winH, f->nW, f->nH, f->aspect_mode))) f->blender.accumulate(f->downscale_tex);
+                cap->end_frame();
+                f->win_cost_ms += (get_time_val() - t_cpu_start) * 1000.0;
+            }
+            if (f->active && f->session && f->b_capture_this_frame && !f->paused) {
+                double t_cpu_start = get_time_val();
                 std::shared_ptr<RecSession> s = f->session;
                 f->b_capture_this_frame = false;
+                f->b_accum_this_frame = false;
                 int recW = f->nW; int recH = f->nH;
-                int sz_bytes = recW * recH * 4;
-
-                // mac retina lies in getFrameSize, ask GL directly so blit src is real pixels
-                GLint vp[4] = {0, 0, 0, 0};
-                glGetIntegerv(GL_VIEWPORT, vp);
-                int winW = vp[2];
-                int winH = vp[3];
-                if (winW <= 0 || winH <= 0) {
-                    CCSize fs2 = CCDirector::get()->getOpenGLView()->getFrameSize();
-                    winW = (int)fs2.width; winH = (int)fs2.height;
-                }
-#ifdef GEODE_IS_MACOS
-                // bro retina displays are FUCKED the viewport is in POINTS not PIXELS
-                // only reason i added macos support is more damn downloads, regret already
-                extern float get_macos_backing_scale();
-                float scale = get_macos_backing_scale();
-                winW = (int)(winW * scale);
-                winH = (int)(winH * scale);
-#endif
+
+                int winW = 0, winH = 0;
+                get_window_px(winW, winH);
+                CaptureBackend* cap = get_capture(f, winW, winH);
 
                 if (!f->b_setup_done) {
-                    glGenBuffers(3, f->pbo_bufer);
-                    for (int i = 0; i < 3; i++) {
-                        glBindBuffer(GL_PIXEL_PACK_BUFFER, f->pbo_bufer[i]);
-                        glBufferData(GL_PIXEL_PACK_BUFFER, sz_bytes, nullptr, GL_DYNAMIC_READ);
-                        f->fences_sync_ptr[i] = 0;
-                    }
-                    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+                    cap->setup(recW, recH);
+#ifdef ECHOCLIP_GPU_TIMERS
+                    glGenQueries(3, f->gpu_q);
+#endif
                     f->b_setup_done = true;
                 }
 
-                if (winW != recW || winH != recH) {
-                    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
-                    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, f->downscale_fbo);
-                    glBlitFramebuffer(0, 0, winW, winH, 0, 0, recW, recH, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+                int writeIdx = cap->write_slot();
+
+#ifdef ECHOCLIP_GPU_TIMERS
+                bool timing = !f->gpu_q_live[writeIdx];
+                if (timing) glBeginQuery(GL_TIME_ELAPSED, f->gpu_q[writeIdx]);
+#endif
+                CaptureGeom geom = compute_capture_geom(winW, winH, recW, recH, f->aspect_mode);
+                int read_x = 0, read_y = 0;
+                // a multisampled gles window cant be read straight off, it goes through the blit like a scaled one
+                // the hud goes on top of the recording copy, so it needs one too
+                if (f->blend || f->hud_on || !geom.is_direct(recW, recH) || !cap->can_read_window()) {
+                    if (!cap->blit_window(f->downscale_fbo, geom)) {
+                        static bool s_blit_warned = false;
+                        if (!s_blit_warned) geode::log::warn("capture: {} couldnt blit the window at {}x{}", cap->name(), winW, winH);
+                        s_blit_warned = true;
+                    }
+                    if (f->blend) {
+                        // capture tick is the end of the shutter, add it in and read back the average instead
+                        f->blender.accumulate(f->downscale_tex);
+                        f->blender.resolve(f->downscale_fbo);
+                    }
+                    if (f->hud_on) f->hud.draw(f->downscale_fbo);
                     glBindFramebuffer(GL_READ_FRAMEBUFFER, f->downscale_fbo);
                 } else {
-                    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+                    // same size as the crop, read the middle of the window straight off
+                    glBindFramebuffer(GL_READ_FRAMEBUFFER, cap->window_fbo());
+                    read_x = geom.sx; read_y = geom.sy;
                 }
 
-                int writeIdx = f->write_idx;
-                int readIdx = (writeIdx + 2) % 3;
-                f->write_idx = (writeIdx + 1) % 3;
-
-                glBindBuffer(GL_PIXEL_PACK_BUFFER, f->pbo_bufer[writeIdx]);
-                glReadPixels(0, 0, recW, recH, GL_BGRA, GL_UNSIGNED_BYTE, 0);
-                if (f->fences_sync_ptr[writeIdx]) { glDeleteSync(f->fences_sync_ptr[writeIdx]); f->fences_sync_ptr[writeIdx] = 0; }
-                f->fences_sync_ptr[writeIdx] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
-                glFlush();
-
-                if (++f->n_pushed_frames > 3 && f->fences_sync_ptr[readIdx]) {
-                    GLint signaled = 0;
-                    glGetSynciv(f->fences_sync_ptr[readIdx], GL_SYNC_STATUS, 1, nullptr, &signaled);
-                    if (signaled == GL_SIGNALED) {
-                        glDeleteSync(f->fences_sync_ptr[readIdx]); f->fences_sync_ptr[readIdx] = 0;
-                        glBindBuffer(GL_PIXEL_PACK_BUFFER, f->pbo_bufer[readIdx]);
-#ifdef GEODE_IS_MACOS
-                        void* p_pix = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
-#else
-                        void* p_pix = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, sz_bytes, GL_MAP_READ_BIT);
+                f->slot_pts[writeIdx] = f->capture_pts;
+                cap->read(read_x, read_y);
+#ifdef ECHOCLIP_GPU_TIMERS
+                if (timing) { glEndQuery(GL_TIME_ELAPSED); f->gpu_q_live[writeIdx] = true; }
 #endif
-                        if (p_pix) {
-                            std::vector<uint8_t> c_pixel;
-                            {
-                                std::lock_guard<std::mutex> l(s->m_p_mtx);
-                                if (!s->pool_frames.empty()) { c_pixel = std::move(s->pool_frames.back()); s->pool_frames.pop_back(); }
-                            }
-                            if ((int)c_pixel.size() != sz_bytes) c_pixel.resize(sz_bytes);
-                            memcpy(c_pixel.data(), p_pix, sz_bytes);
-                            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
-
-                            std::lock_guard<std::mutex> lp(s->m_p_mtx);
-                            std::lock_guard<std::mutex> lq(s->m_q_mtx);
-                            if ((int)s->c_pixel_q.size() < s->max_frames) {
-                                s->c_pixel_q.push(std::move(c_pixel));
-                                s->m_cv.notify_one();
-                            } else if ((int)s->pool_frames.size() < s->max_frames) {
-                                s->pool_frames.push_back(std::move(c_pixel));
-                            }
-                        }
+
+                if (++f->n_pushed_frames > 3) {
+                    int64_t pts = f->slot_pts[cap->read_slot()];
+                    if (uint8_t const* p_pix = cap->acquire()) {
+                        // straight from the mapped pbo into the buffer the recorder gets, unmapped right after
+                        FrameView v;
+                        v.data = p_pix;
+                        v.w = recW; v.h = recH;
+                        v.fmt = cap->format();
+                        v.pts = pts;
+                        v.release = [cap] { cap->release(); };
+                        s->submit(v);
                     }
                 }
-                glBindFramebuffer(GL_FRAMEBUFFER, 0);
-                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+                cap->end_frame();
+                f->win_cost_ms += (get_time_val() - t_cpu_start) * 1000.0;
             }
+            if (f->active && f->session && f->b_setup_done) static_cast<MyBaseGameLayer*>(layer)->check_capture_budget();
         }
         CCEGLView::swapBuffers();
     }
@@ -443,6 +663,7 @@ class $modify(MyPlayLayer, PlayLayer) {
     void togglePracticeMode(bool practice) {
         PlayLayer::togglePracticeMode(practice);
         MyBaseGameLayer* bgl = static_cast<MyBaseGameLayer*>(static_cast<GJBaseGameLayer*>(this));
+        bgl->mark_event("practice", practice ? 1 : 0);
         if (practice && !Mod::get()->getSettingValue<bool>("record-practice")) {
             bgl->kill_rec();
         } else if (!practice && Mod::get()->getSettingValue<bool>("enabled")) {
@@ -474,6 +695,7 @@ class $modify(MyPlayLayer, PlayLayer) {
         MyBaseGameLayer* bgl = static_cast<MyBaseGameLayer*>(static_cast<GJBaseGameLayer*>(this));
         MyBaseGameLayer::Fields* f = bgl->m_fields.self();
         if (!f || !m_level) return;
+        bgl->mark_event("complete", 100);
         std::shared_ptr<RecSession> s = bgl->kill_rec();
         if (s) {
             finalize_and_save(s, f->s_lvl_str, f->current_rec_att);
@@ -487,10 +709,13 @@ class $modify(MyPlayLayer, PlayLayer) {
         PlayLayer::destroyPlayer(boi, obj);
         MyBaseGameLayer* bgl = static_cast<MyBaseGameLayer*>(static_cast<GJBaseGameLayer*>(this));
         MyBaseGameLayer::Fields* f = bgl->m_fields.self();
-        if (!f || !f->clip_new_best || !m_player1 || !m_level) return;
+        if (!f || !m_player1 || !m_level || (obj && obj == m_anticheatSpike)) return;
         int cur = (int)this->getCurrentPercent();
+        bgl->mark_event("death", cur);
         if (cur <= f->best_percent) return;
         f->best_percent = cur;
+        bgl->mark_event("new_best", cur);
+        if (!f->clip_new_best) return;
         std::shared_ptr<RecSession> s = bgl->kill_rec();
         if (s) {
             finalize_and_save(s, f->s_lvl_str, f->current_rec_att);
@@ -525,6 +750,26 @@ class $modify(MyPauseLayer, PauseLayer) {
         menu->updateLayout();
     }
 
+    // no point recording the pause menu, stop ticking until it goes away
+    void onEnter() {
+        PauseLayer::onEnter();
+        if (auto bgl = GJBaseGameLayer::get()) {
+            MyBaseGameLayer::Fields* f = static_cast<MyBaseGameLayer*>(bgl)->m_fields.self();
+            f->paused = true;
+            f->b_capture_this_frame = false;
+        }
+    }
+
+    void onExit() {
+        PauseLayer::onExit();
+        if (auto bgl = GJBaseGameLayer::get()) {
+            MyBaseGameLayer::Fields* f = static_cast<MyBaseGameLayer*>(bgl)->m_fields.self();
+            f->paused = false;
+            f->f_timer_val = 0;
+            f->last_clock = -1;
+        }
+    }
+
     void onGallery(CCObject*) {
         Gallery::open();
     }
@@ -1,4 +1,7 @@
 #include "ui.hpp"
+#include "common/common.hpp"
+#include "common/compile.hpp"
+#include "common/file_jobs.hpp"
 #include <Geode/Geode.hpp>
 #include <Geode/cocos/extensions/GUI/CCScrollView/CCScrollView.h>
 #include <Geode/ui/GeodeUI.hpp>
@@ -14,6 +17,25 @@
 using namespace geode::prelude;
 namespace fs = std::filesystem;
 
+// gallery file ops all go through the FileJobs thread in order, so a scan queued after an op always sees it
+// main thread only
+static int s_ops_in_flight = 0;
+static bool s_scan_queued = false;
+static bool s_scan_again = false;
+
+// fail_msg shows if fn returns false, the gallery rescans once the last op of a burst lands
+static void run_file_op(std::function<bool()> fn, std::string fail_msg) {
+    s_ops_in_flight++;
+    FileJobs::get().submit([fn = std::move(fn), fail_msg] {
+        bool ok = fn();
+        Loader::get()->queueInMainThread([ok, fail_msg] {
+            s_ops_in_flight--;
+            if (!ok) Notification::create(fail_msg, CCSprite::createWithSpriteFrameName("GJ_deleteBtn_001.png"))->show();
+            if (s_ops_in_flight == 0) Gallery::refresh();
+        });
+    });
+}
+
 std::string format_time_str(fs::file_time_type ft) {
     auto system_tp = std::chrono::time_point_cast<std::chrono::system_clock::duration>(
         ft - fs::file_time_type::clock::now() + std::chrono::system_clock::now()
@@ -67,6 +89,7 @@ bool Card::init(Clip data_info, float w, float h) {
     p_menu_layer->setContentSize({w, h});
     p_menu_layer->setTouchPriority(-502);
     addChild(p_menu_layer, 10);
+    p_menu_ptr = p_menu_layer;
     
     auto p_play_spr = CCSprite::createWithSpriteFrameName("GJ_playBtn2_001.png"); 
     p_play_spr->setScale(0.3f);
@@ -91,6 +114,17 @@ bool Card::init(Clip data_info, float w, float h) {
     return true;
 }
 
+void Card::setSelectable(bool b_selected) {
+    auto p_toggle = CCMenuItemToggler::createWithStandardSprites(this, menu_selector(Card::onSelect), 0.45f);
+    p_toggle->toggle(b_selected);
+    p_toggle->setPosition(getContentSize().width - 80, getContentSize().height / 2);
+    p_menu_ptr->addChild(p_toggle);
+}
+
+void Card::onSelect(CCObject*) {
+    if (Gallery* p_g = Gallery::get()) p_g->toggleSelected(m_info_struct.p_path);
+}
+
 void Card::onPlay(CCObject*) {
 #ifdef GEODE_IS_WINDOWS
     ShellExecuteA(NULL, "open", geode::utils::string::pathToString(m_info_struct.p_path).c_str(), NULL, NULL, SW_SHOWNORMAL);
@@ -98,7 +132,6 @@ void Card::onPlay(CCObject*) {
 }
 
 void Card::onFavorite(CCObject*) {
-    std::error_code ec;
     fs::path clips_dir = Mod::get()->getSaveDir() / "clips";
     fs::path new_path;
     
@@ -109,18 +142,31 @@ void Card::onFavorite(CCObject*) {
         new_path = clips_dir / "favorites" / m_info_struct.s_lvl / filename;
     }
     
-    fs::create_directories(new_path.parent_path(), ec);
-    fs::rename(m_info_struct.p_path, new_path, ec);
-    Gallery::refresh();
+    fs::path old_path = m_info_struct.p_path;
+    run_file_op([old_path, new_path] {
+        std::error_code ec;
+        fs::create_directories(new_path.parent_path(), ec);
+        fs::rename(old_path, new_path, ec);
+        if (ec) return false;
+        fs::rename(sidecar_path(old_path), sidecar_path(new_path), ec);
+        return true;
+    }, "Couldn't move clip!");
+    // this card is gone after the rebuild, nothing of it is touched past here
+    if (Gallery* p_g = Gallery::get()) p_g->moveClip(old_path, new_path, !m_info_struct.b_is_fav);
 }
 
 void Card::onDelete(CCObject*) {
     fs::path p_path_ptr = m_info_struct.p_path;
     geode::createQuickPopup("Delete Clip", "Delete this clip?", "No", "Yes", [p_path_ptr](auto, bool b_is_yes) {
         if (b_is_yes) { 
-            std::error_code ec_err; 
-            fs::remove(p_path_ptr, ec_err); 
-            Gallery::refresh(); 
+            run_file_op([p_path_ptr] {
+                std::error_code ec_err;
+                fs::remove(p_path_ptr, ec_err);
+                if (ec_err) return false;
+                fs::remove(sidecar_path(p_path_ptr), ec_err);
+                return true;
+            }, "Couldn't delete clip!");
+            if (Gallery* p_g = Gallery::get()) p_g->removeClip(p_path_ptr);
         }
     });
 }
@@ -146,15 +192,57 @@ void Gallery::open() {
     s_cur_scene->addChild(p_gal_layer, s_cur_scene->getHighestChildZ() + 1);
 }
 
-void Gallery::refresh() {
+Gallery* Gallery::get() {
     auto p_scene_ptr = CCDirector::get()->getRunningScene(); 
-    if (!p_scene_ptr) return;
-    Gallery* p_g = typeinfo_cast<Gallery*>(p_scene_ptr->getChildByID("axiom.echoclip/gallery"));
-    if (p_g) { 
-        p_g->load(); 
-        p_g->v_filtered_list = p_g->v_all_clips; 
-        p_g->build(); 
+    if (!p_scene_ptr) return nullptr;
+    return typeinfo_cast<Gallery*>(p_scene_ptr->getChildByID("axiom.echoclip/gallery"));
+}
+
+void Gallery::refresh() {
+    if (!get()) return;
+    if (s_scan_queued) { s_scan_again = true; return; }
+    s_scan_queued = true;
+    FileJobs::get().submit([] {
+        std::vector<Clip> v_clips = Gallery::scan();
+        Loader::get()->queueInMainThread([v_clips = std::move(v_clips)]() mutable {
+            s_scan_queued = false;
+            // something changed while this one was scanning, its already stale
+            if (s_scan_again || s_ops_in_flight > 0) {
+                s_scan_again = false;
+                if (s_ops_in_flight == 0) refresh();
+                return;
+            }
+            if (Gallery* p_g = get()) p_g->applyScan(std::move(v_clips));
+        });
+    });
+}
+
+void Gallery::applyScan(std::vector<Clip> v_clips) {
+    v_all_clips = std::move(v_clips);
+    b_loaded = true;
+    // selected clips that vanished on disk cant be joined anymore
+    std::erase_if(v_selected, [this](fs::path const& p) {
+        return std::none_of(v_all_clips.begin(), v_all_clips.end(), [&p](Clip const& c) { return c.p_path == p; });
+    });
+    updateCompileLabel();
+    applyFilter();
+}
+
+void Gallery::removeClip(fs::path const& p) {
+    std::erase_if(v_all_clips, [&p](Clip const& c) { return c.p_path == p; });
+    std::erase(v_selected, p);
+    updateCompileLabel();
+    applyFilter();
+}
+
+void Gallery::moveClip(fs::path const& from, fs::path const& to, bool b_fav) {
+    for (auto& c : v_all_clips) {
+        if (c.p_path != from) continue;
+        c.p_path = to;
+        c.b_is_fav = b_fav;
     }
+    std::replace(v_selected.begin(), v_selected.end(), from, to);
+    applyFilter();
 }
 
 bool Gallery::init() {
@@ -222,9 +310,8 @@ bool Gallery::init() {
     cool_scroller->setTouchPriority(-501); 
     p_MainPanel->addChild(cool_scroller, 1);
     
-    load(); 
-    v_filtered_list = v_all_clips; 
     build();
+    refresh();
     
     auto p_bottom_bg = CCLayerColor::create({30, 30, 35, 255}, f_width, 42); 
     p_bottom_bg->setPosition(0, 0); 
@@ -246,6 +333,8 @@ bool Gallery::init() {
 #endif
     p_bottom_menu->addChild(CCMenuItemSpriteExtra::create(ButtonSprite::create("Settings", "goldFont.fnt", "GJ_button_04.png", 0.6f), nullptr, this, menu_selector(Gallery::onSettings)));
     p_bottom_menu->addChild(CCMenuItemSpriteExtra::create(ButtonSprite::create("Clear All", "goldFont.fnt", "GJ_button_06.png", 0.6f), nullptr, this, menu_selector(Gallery::onClear)));
+    p_compile_spr = ButtonSprite::create("Compile", "goldFont.fnt", "GJ_button_04.png", 0.6f);
+    p_bottom_menu->addChild(CCMenuItemSpriteExtra::create(p_compile_spr, nullptr, this, menu_selector(Gallery::onCompile)));
     p_bottom_menu->updateLayout();
     
     p_count_label_ptr = CCLabelBMFont::create("0 clips", "chatFont.fnt");
@@ -259,8 +348,12 @@ bool Gallery::init() {
     return true;
 }
 
-void Gallery::textChanged(CCTextInputNode* p_inp) {
-    std::string s_query = p_inp->getString();
+void Gallery::textChanged(CCTextInputNode*) {
+    applyFilter();
+}
+
+void Gallery::applyFilter() {
+    std::string s_query = p_SearchBox ? p_SearchBox->getString() : "";
     if (s_query.empty()) v_filtered_list = v_all_clips;
     else { 
         v_filtered_list.clear(); 
@@ -287,7 +380,7 @@ void Gallery::build() {
     int count_val = (int)v_filtered_list.size();
     
     if (count_val == 0) {
-        auto p_error_lbl = CCLabelBMFont::create("no clips yet? go beat a lvl or smh", "chatFont.fnt"); 
+        auto p_error_lbl = CCLabelBMFont::create(b_loaded ? "no clips yet? go beat a lvl or smh" : "loading clips...", "chatFont.fnt"); 
         p_error_lbl->setScale(0.5f); p_error_lbl->setColor({80, 80, 80}); 
         p_error_lbl->setPosition({f_w_in / 2, cool_scroller->getViewSize().height / 2});
         p_inner_container->setContentSize(cool_scroller->getViewSize()); 
@@ -340,6 +433,7 @@ void Gallery::build() {
 
         float card_w = (f_w_in - pad_val) / 2;
         Card* box = Card::create(clip, card_w, card_h);
+        if (b_select_mode) box->setSelectable(std::find(v_selected.begin(), v_selected.end(), clip.p_path) != v_selected.end());
         float x = (row_in_group % 2) * (card_w + pad_val);
         float y = cur_y - (row_in_group / 2 + 1) * (card_h + pad_val) + pad_val;
         box->setPosition({x, y});
@@ -355,11 +449,11 @@ void Gallery::build() {
     cool_scroller->setContentOffset({0, cool_scroller->getViewSize().height - total_h});
 }
 
-void Gallery::load() {
-    v_all_clips.clear(); 
+std::vector<Clip> Gallery::scan() {
+    std::vector<Clip> v_all_clips;
     std::error_code ec;
     fs::path d_path_obj = Mod::get()->getSaveDir() / "clips"; 
-    if (!fs::exists(d_path_obj, ec)) return;
+    if (!fs::exists(d_path_obj, ec)) return v_all_clips;
     
     for (auto& entry_ptr : fs::recursive_directory_iterator(d_path_obj, ec)) {
         if (ec) break;
@@ -394,6 +488,7 @@ void Gallery::load() {
         std::error_code ec1, ec2;
         return fs::last_write_time(a.p_path, ec1) > fs::last_write_time(b.p_path, ec2); 
     });
+    return v_all_clips;
 }
 
 void Gallery::onFolder(CCObject*) {
@@ -402,30 +497,76 @@ void Gallery::onFolder(CCObject*) {
 
 void Gallery::onSettings(CCObject*) { geode::openSettingsPopup(Mod::get()); }
 void Gallery::onRefresh(CCObject* p_unused) { 
-    load(); 
-    v_filtered_list = v_all_clips; 
-    build(); 
-    if (p_count_label_ptr) p_count_label_ptr->setString(fmt::format("{} clips", v_filtered_list.size()).c_str()); 
+    refresh();
 }
 
 void Gallery::onClear(CCObject*) {
     geode::createQuickPopup("Clear All", "Delete all non-favorite clips?\nThis can't be undone.", "No", "Yes", [this](auto, bool b_sure) { // sorry if ui is shit i did my best
         if (b_sure) { 
-            std::error_code ec;
-            fs::path clips_dir = Mod::get()->getSaveDir() / "clips";
-            if (fs::exists(clips_dir, ec)) {
+            run_file_op([] {
+                std::error_code ec;
+                bool ok = true;
+                fs::path clips_dir = Mod::get()->getSaveDir() / "clips";
+                if (!fs::exists(clips_dir, ec)) return true;
                 for (auto const& entry : fs::directory_iterator(clips_dir, ec)) {
                     auto name = geode::utils::string::pathToString(entry.path().filename());
                     if (name != "favorites" && name != "temp") {
                         fs::remove_all(entry.path(), ec);
+                        if (ec) ok = false;
                     }
                 }
-            }
-            onRefresh(nullptr); 
+                return ok;
+            }, "Couldn't delete some clips!");
+            std::erase_if(v_all_clips, [](Clip const& c) { return !c.b_is_fav; });
+            std::erase_if(v_selected, [this](fs::path const& p) {
+                return std::none_of(v_all_clips.begin(), v_all_clips.end(), [&p](Clip const& c) { return c.p_path == p; });
+            });
+            updateCompileLabel();
+            applyFilter();
         } 
     });
 }
 
+void Gallery::toggleSelected(fs::path const& p) {
+    auto it = std::find(v_selected.begin(), v_selected.end(), p);
+    if (it != v_selected.end()) v_selected.erase(it);
+    else v_selected.push_back(p);
+    updateCompileLabel();
+}
+
+void Gallery::updateCompileLabel() {
+    if (!p_compile_spr) return;
+    if (!b_select_mode) p_compile_spr->setString("Compile");
+    else p_compile_spr->setString(v_selected.size() < 2 ? "Cancel" : fmt::format("Join {}", v_selected.size()).c_str());
+}
+
+void Gallery::onCompile(CCObject*) {
+    if (!b_select_mode || v_selected.size() < 2) {
+        b_select_mode = !b_select_mode;
+        v_selected.clear();
+        updateCompileLabel();
+        build();
+        return;
+    }
+    // sorting by date stats every file, the compile job does that off the main thread
+    std::vector<std::pair<fs::path, std::string>> v_join;
+    for (auto const& p : v_selected) {
+        std::string s_lvl = "Compilation";
+        for (auto& c : v_all_clips) if (c.p_path == p) { s_lvl = c.s_lvl; break; }
+        v_join.push_back({p, s_lvl});
+    }
+
+    if (!compile_clips_async(v_join)) {
+        Notification::create("Already compiling!", CCSprite::createWithSpriteFrameName("GJ_infoIcon_001.png"))->show();
+        return;
+    }
+    Notification::create(fmt::format("Compiling {} clips...", v_join.size()), CCSprite::createWithSpriteFrameName("GJ_completesIcon_001.png"))->show();
+    b_select_mode = false;
+    v_selected.clear();
+    updateCompileLabel();
+    build();
+}
+
 void Gallery::onClose(CCObject*) { removeFromParent(); }
 void Gallery::keyBackClicked() { removeFromParent(); }
 // if whoever is reviewing this has patience to help with the ui pls do, i did my  best :sob:, pls make a pr
@@ -22,6 +22,9 @@ public:
     static Card* create(Clip info, float w, float h);
     bool init(Clip info, float w, float h);
     Clip m_info_struct;
+    CCMenu* p_menu_ptr = nullptr;
+    void setSelectable(bool b_selected);
+    void onSelect(CCObject* pSender);
     void onPlay(CCObject* pSender);
     void onDelete(CCObject* pSender);
     void onFavorite(CCObject* pSender);
@@ -31,7 +34,11 @@ class Gallery : public CCLayerColor, public TextInputDelegate {
 public:
     static Gallery* create();
     static void open();
+    // rescans clips/ on the disk thread, calls while one is in flight fold into a single rescan after it
     static void refresh();
+    static Gallery* get();
+    // the filesystem part of a refresh, runs on the disk thread
+    static std::vector<Clip> scan();
 
     bool init() override;
     void keyBackClicked() override;
@@ -45,12 +52,26 @@ public:
     CCTextInputNode* p_SearchBox;
     std::vector<Clip> v_all_clips;
     std::vector<Clip> v_filtered_list;
+    // compile mode, cards get a checkbox and the button joins whatever is ticked
+    bool b_select_mode = false;
+    std::vector<fs::path> v_selected;
+    ButtonSprite* p_compile_spr = nullptr;
 
-    void load();
+    // false until the first scan lands, the empty list says loading instead of no clips
+    bool b_loaded = false;
+
+    void applyScan(std::vector<Clip> v_clips);
+    void applyFilter();
+    // optimistic edits, the disk op is already queued. a failed op gets undone by the rescan after it
+    void removeClip(fs::path const& p);
+    void moveClip(fs::path const& from, fs::path const& to, bool b_fav);
     void build();
     void onFolder(CCObject* p_obj);
     void onSettings(CCObject* p_obj);
     void onRefresh(CCObject* p_obj);
     void onClear(CCObject* p_obj);
+    void onCompile(CCObject* p_obj);
+    void toggleSelected(fs::path const& p);
+    void updateCompileLabel();
     void onClose(CCObject* p_obj);// if whoever is reviewing this has patience to help with the ui pls do, i did my  best :sob:
 };
\ No newline at end of file
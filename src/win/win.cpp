@@ -5,14 +5,12 @@
 #include <dxgi.h>
 #include "win.hpp"
 #include "common/common.hpp"
-#include <Geode/utils/async.hpp>
 #include <Geode/utils/string.hpp>
-#include <eclipse.ffmpeg-api/include/events.hpp>
-#include "ui.hpp"
 #include <chrono>
 #include <cstdlib>
 #include <ctime>
 #include <algorithm>
+#include <atomic>
 
 using namespace geode::prelude;
 namespace fs = std::filesystem;
@@ -70,74 +68,29 @@ int64_t get_total_ram_mb() {
     return 4096;
 }
 
-void save_clip(fs::path srcPath, std::string sLvlName, int nAttempts) {
-    std::error_code ec;
-    if (srcPath.empty() || !fs::exists(srcPath, ec)) return;
-    geode::async::spawn([srcPath, sLvlName, nAttempts]() mutable -> arc::Future<> {
-        std::error_code ec;
-        fs::path p_root_clips = Mod::get()->getSaveDir() / "clips";
+static std::atomic<int> s_main_cpu{-1};
 
-        std::string clean_name = sLvlName;
-        if (clean_name.empty()) clean_name = "Unknown";
-        for (char& c : clean_name)
-            if (c == '/' || c == '\\' || c == ':' || c == '*' || c == '?' || c == '"' || c == '<' || c == '>' || c == '|') c = '_';
-        if (clean_name.size() > 80) clean_name = clean_name.substr(0, 80);
-
-        fs::path p_lvl_dir = p_root_clips / clean_name;
-        fs::create_directories(p_lvl_dir, ec);
-
-        fs::path out_file_path = p_lvl_dir / fmt::format("{}_att{}_{}.mp4", clean_name, nAttempts, (long long)::time(0));
-
-        bool success = false;
-
-        {
-            fs::path tmp_out = Mod::get()->getSaveDir() / "temp" / fmt::format("_tmp_{}_{}.mp4", (long long)::time(0), rand() % 1000);
-            std::string codec = get_codec();
-            std::string ff_bin;
-            auto ffmpegMod = Loader::get()->getLoadedMod("eclipse.ffmpeg-api");
-            if (ffmpegMod) {
-                auto path = ffmpegMod->getResourcesDir() / "ffmpeg.exe";
-                if (fs::exists(path, ec)) ff_bin = "\"" + geode::utils::string::pathToString(path) + "\"";
-            }
-
-            if (ff_bin.empty()) {
-                fs::rename(srcPath, out_file_path, ec);
-                if (!ec) success = true;
-            } else {
-                std::string ff_cmd = fmt::format("{} -y -i \"{}\" -metadata title=\"EchoClip\" -c:v {} -preset medium -crf 23 -pix_fmt yuv420p -movflags +faststart \"{}\"",
-                    ff_bin, geode::utils::string::pathToString(srcPath), codec, geode::utils::string::pathToString(tmp_out));
-
-                STARTUPINFOA si = { sizeof(si) };
-                PROCESS_INFORMATION pi = {};
-                std::vector<char> buf(ff_cmd.begin(), ff_cmd.end()); buf.push_back(0);
-                if (CreateProcessA(NULL, buf.data(), NULL, NULL, FALSE, CREATE_NO_WINDOW, NULL, NULL, &si, &pi)) {
-                    WaitForSingleObject(pi.hProcess, INFINITE);
-                    CloseHandle(pi.hProcess); CloseHandle(pi.hThread);
-                }
-
-                if (fs::exists(tmp_out, ec)) {
-                    fs::remove(srcPath, ec); fs::rename(tmp_out, out_file_path, ec);
-                    if (!ec) success = true;
-                } else {
-                    fs::rename(srcPath, out_file_path, ec);
-                    if (!ec) success = true;
-                }
-            }
-        }
+void note_main_thread() {
+    s_main_cpu.store((int)GetCurrentProcessorNumber());
+}
 
-        cleanup_old_clips(p_root_clips);
+// ideal processor is only a hint, so this nudges workers off the main thread's core without pinning anything
+void apply_worker_thread_policy() {
+    int lvl = get_thread_priority_level();
+    SetThreadPriority(GetCurrentThread(), lvl == 2 ? THREAD_PRIORITY_LOWEST : lvl == 1 ? THREAD_PRIORITY_BELOW_NORMAL : THREAD_PRIORITY_NORMAL);
+    int main_cpu = s_main_cpu.load();
+    DWORD n_cpu = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+    if (main_cpu >= 0 && n_cpu > 1 && n_cpu <= 64) {
+        static std::atomic<int> s_next{0};
+        DWORD ideal = (DWORD)((main_cpu + 1 + s_next.fetch_add(1) % (n_cpu - 1)) % n_cpu);
+        SetThreadIdealProcessor(GetCurrentThread(), ideal);
+    }
+}
 
-        Loader::get()->queueInMainThread([success] {
-            if (!CCDirector::get()->getRunningScene()) return;
-            if (success) {
-                Notification::create("Clip Saved!", CCSprite::createWithSpriteFrameName("GJ_completesIcon_001.png"))->show();
-                Gallery::refresh();
-            } else {
-                Notification::create("Save Failed!", CCSprite::createWithSpriteFrameName("GJ_deleteBtn_001.png"))->show();
-            }
-        });
-        co_return;
-    });
+fs::path get_ffmpeg_path() {
+    auto ffmpegMod = Loader::get()->getLoadedMod("eclipse.ffmpeg-api");
+    if (!ffmpegMod) return {};
+    return ffmpegMod->getResourcesDir() / "ffmpeg.exe";
 }
 
 #endif
@@ -4,11 +4,13 @@
 #include <string>
 #include <filesystem>
 #include <cstdint>
+#include <vector>
+#include "common/common.hpp"
 
 bool check_vram_low();
 bool is_running_under_wine();
 std::string get_codec();
 int64_t get_total_ram_mb();
-void save_clip(std::filesystem::path srcPath, std::string sLvlName, int nAttempts);
+std::filesystem::path get_ffmpeg_path();
 
 #endif
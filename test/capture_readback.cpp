@@ -0,0 +1,126 @@
+// headless check of the gles 3 capture backend, built with -DECHOCLIP_CAPTURE_TEST=ON (no geode, no game)
+// draws four solid quadrants into a window sized fbo, runs it through the same begin/blit/read/acquire path main.cpp uses
+// and checks the colors come out where they should after copy_frame. needs a surfaceless egl, mesa llvmpipe is enough
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include "capture.hpp"
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+static GLuint make_fbo(int w, int h, GLuint* tex) {
+    GLuint fbo = 0;
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glGenTextures(1, tex);
+    glBindTexture(GL_TEXTURE_2D, *tex);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, w, h);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, *tex, 0);
+    return fbo;
+}
+
+static bool make_context() {
+    auto get_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (!get_display) return false;
+    EGLDisplay dpy = get_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    if (dpy == EGL_NO_DISPLAY || !eglInitialize(dpy, nullptr, nullptr)) return false;
+    eglBindAPI(EGL_OPENGL_ES_API);
+    EGLint attrs[] = { EGL_CONTEXT_MAJOR_VERSION, 3, EGL_NONE };
+    EGLContext ctx = eglCreateContext(dpy, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attrs);
+    return ctx != EGL_NO_CONTEXT && eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx);
+}
+
+struct Case {
+    int win_w, win_h, rec_w, rec_h;
+    CaptureAspect aspect;
+};
+
+int main() {
+    if (!make_context()) {
+        std::puts("no surfaceless egl context, skipping");
+        // ctest SKIP_RETURN_CODE
+        return 77;
+    }
+    char const* ver = (char const*)glGetString(GL_VERSION);
+    std::printf("%s / %s\n", ver, (char const*)glGetString(GL_RENDERER));
+
+    // direct read, scaled blit, and a crop that has to pick the middle of the window
+    Case cases[] = {
+        { 1280, 720, 1280, 720, CaptureAspect::Native },
+        { 1920, 1080, 1280, 720, CaptureAspect::Native },
+        { 800, 600, 640, 360, CaptureAspect::Crop16x9 },
+    };
+    int fails = 0;
+    for (Case const& c : cases) {
+        GLuint win_tex = 0, dst_tex = 0;
+        GLuint win = make_fbo(c.win_w, c.win_h, &win_tex);
+        GLuint dst = make_fbo(c.rec_w, c.rec_h, &dst_tex);
+
+        // bottom left red, bottom right green, top left blue, top right white (gl rows are bottom up)
+        glBindFramebuffer(GL_FRAMEBUFFER, win);
+        glEnable(GL_SCISSOR_TEST);
+        float cols[4][3] = { {1, 0, 0}, {0, 1, 0}, {0, 0, 1}, {1, 1, 1} };
+        for (int q = 0; q < 4; q++) {
+            glScissor((q % 2) * c.win_w / 2, (q / 2) * c.win_h / 2, c.win_w / 2, c.win_h / 2);
+            glClearColor(cols[q][0], cols[q][1], cols[q][2], 1.f);
+            glClear(GL_COLOR_BUFFER_BIT);
+        }
+        glDisable(GL_SCISSOR_TEST);
+
+        std::unique_ptr<CaptureBackend> cap = make_capture_backend(ver);
+        cap->setup(c.rec_w, c.rec_h);
+        std::vector<uint8_t> out((size_t)c.rec_w * c.rec_h * 4);
+        bool got = false;
+        double read_ms = 0;
+        int frames = 0;
+        // readback is pipelined, the first frame only comes out a couple of reads later
+        for (int fr = 0; fr < 10 && !got; fr++) {
+            glBindFramebuffer(GL_FRAMEBUFFER, win);
+            cap->begin_frame(c.win_w, c.win_h);
+            CaptureGeom geom = compute_capture_geom(c.win_w, c.win_h, c.rec_w, c.rec_h, c.aspect);
+            int rx = 0, ry = 0;
+            if (!geom.is_direct(c.rec_w, c.rec_h) || !cap->can_read_window()) {
+                cap->blit_window(dst, geom);
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, dst);
+            } else {
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, cap->window_fbo());
+                rx = geom.sx; ry = geom.sy;
+            }
+            auto t0 = std::chrono::steady_clock::now();
+            cap->read(rx, ry);
+            if (uint8_t const* p = cap->acquire()) {
+                FrameView v;
+                v.data = p; v.w = c.rec_w; v.h = c.rec_h; v.fmt = cap->format();
+                copy_frame(v, out.data());
+                cap->release();
+                got = true;
+            }
+            read_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            frames++;
+            cap->end_frame();
+            glFinish();
+        }
+        if (!got) { std::printf("  %dx%d: no frame came out\n", c.win_w, c.win_h); fails++; }
+
+        // copy_frame hands out bgra whatever the backend read
+        auto check = [&](int x, int y, int b, int g, int r) {
+            uint8_t const* p = &out[((size_t)y * c.rec_w + x) * 4];
+            if (p[0] == b && p[1] == g && p[2] == r && p[3] == 255) return;
+            std::printf("  bad pixel at %d,%d: %d %d %d %d\n", x, y, p[0], p[1], p[2], p[3]);
+            fails++;
+        };
+        check(c.rec_w / 4, c.rec_h / 4, 0, 0, 255);
+        check(3 * c.rec_w / 4, c.rec_h / 4, 0, 255, 0);
+        check(c.rec_w / 4, 3 * c.rec_h / 4, 255, 0, 0);
+        check(3 * c.rec_w / 4, 3 * c.rec_h / 4, 255, 255, 255);
+        std::printf("%dx%d -> %dx%d via %s, %.3fms cpu per read\n", c.win_w, c.win_h, c.rec_w, c.rec_h, cap->name(), read_ms / std::max(1, frames));
+
+        cap->destroy();
+        glDeleteFramebuffers(1, &win); glDeleteFramebuffers(1, &dst);
+        glDeleteTextures(1, &win_tex); glDeleteTextures(1, &dst_tex);
+    }
+    std::printf("%d failed checks\n", fails);
+    return fails == 0 ? 0 : 1;
+}
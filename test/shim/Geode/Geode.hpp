@@ -0,0 +1,48 @@
+#pragma once
+// just enough of geode for the ffmpeg side (common/process.cpp, common/transcode.cpp) to build into a plain test binary
+#include <fmt/format.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <cstdio>
+#include <utility>
+
+namespace geode {
+    class Mod {
+    public:
+        static Mod* get() { static Mod inst; return &inst; }
+        // the test points this at its scratch dir
+        std::filesystem::path save_dir;
+        std::filesystem::path getSaveDir() const { return save_dir; }
+    };
+
+    namespace log {
+        template <class... Args> void info(fmt::format_string<Args...> f, Args&&... args) { std::printf("[info] %s\n", fmt::format(f, std::forward<Args>(args)...).c_str()); }
+        template <class... Args> void warn(fmt::format_string<Args...> f, Args&&... args) { std::printf("[warn] %s\n", fmt::format(f, std::forward<Args>(args)...).c_str()); }
+        template <class... Args> void debug(fmt::format_string<Args...> f, Args&&... args) { std::printf("[debug] %s\n", fmt::format(f, std::forward<Args>(args)...).c_str()); }
+    }
+
+    namespace utils::string {
+        inline std::string pathToString(std::filesystem::path const& p) { return p.string(); }
+    }
+
+    namespace utils::file {
+        struct WriteResult {
+            bool ok;
+            bool isOk() const { return ok; }
+            bool isErr() const { return !ok; }
+        };
+        inline WriteResult writeString(std::filesystem::path const& p, std::string const& s) {
+            std::ofstream f(p, std::ios::binary);
+            f << s;
+            return {(bool)f};
+        }
+    }
+
+    namespace prelude {
+        using geode::Mod;
+        namespace log = geode::log;
+    }
+}
+
+#define $on_game(ev) [[maybe_unused]] static void echoclip_on_game_##ev()
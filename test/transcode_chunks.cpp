@@ -0,0 +1,117 @@
+// synthetic check of the chunked transcode, built with -DECHOCLIP_TRANSCODE_TEST=ON against a small geode shim (test/shim)
+// a testsrc clip goes through transcode_chunked and the decoded output has to have the same frame count as the source,
+// with pts going up by exactly one frame every time and the same frame hashes (its a lossless encode). thats where the
+// segment split, -reset_timestamps and the concat copy would show dropped, doubled or reordered frames
+// needs ffmpeg with libx264 on PATH (or ECHOCLIP_FFMPEG), skips without it
+#include <Geode/Geode.hpp>
+#include "common/common.hpp"
+#include "common/process.hpp"
+#include "common/transcode.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+// the bits of common.cpp process.cpp needs, without the rest of the mod
+double get_time_val() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+int get_thread_priority_level() { return 0; }
+
+static fs::path find_ffmpeg() {
+    if (char const* env = std::getenv("ECHOCLIP_FFMPEG")) return env;
+    char const* path = std::getenv("PATH");
+    std::string rest = path ? path : "";
+    while (!rest.empty()) {
+        size_t sep = rest.find(':');
+        fs::path p = fs::path(rest.substr(0, sep)) / "ffmpeg";
+        std::error_code ec;
+        if (fs::exists(p, ec)) return p;
+        rest = sep == std::string::npos ? "" : rest.substr(sep + 1);
+    }
+    return {};
+}
+
+struct Frames {
+    int n = 0;
+    std::vector<std::string> hashes;
+    bool continuous = true;
+    long long first_bad = -1;
+};
+
+// decodes p and reads the framemd5 lines ("stream, dts, pts, duration, size, hash"), every pts has to be the last + its duration
+static Frames decode_frames(std::string const& ff_bin, fs::path const& p) {
+    Frames out;
+    long long last_pts = 0, last_dur = 0;
+    ProcOptions opts;
+    opts.timeout_s = 120.0;
+    opts.on_line = [&](std::string const& line) {
+        if (line.empty() || line[0] == '#') return;
+        long long stream = 0, dts = 0, pts = 0, dur = 0;
+        if (std::sscanf(line.c_str(), "%lld, %lld, %lld, %lld", &stream, &dts, &pts, &dur) != 4 || stream != 0) return;
+        if (out.n > 0 && pts != last_pts + last_dur && out.continuous) {
+            out.continuous = false;
+            out.first_bad = out.n;
+        }
+        last_pts = pts; last_dur = dur;
+        out.hashes.push_back(line.substr(line.rfind(',') + 1));
+        out.n++;
+    };
+    run_child(fmt::format("{} -v error -i \"{}\" -map 0:v:0 -f framemd5 -", ff_bin, p.string()), opts);
+    return out;
+}
+
+int main() {
+    fs::path ff = find_ffmpeg();
+    if (ff.empty()) {
+        std::puts("no ffmpeg, skipping");
+        return 77;
+    }
+    std::string ff_bin = "\"" + ff.string() + "\"";
+
+    std::error_code ec;
+    fs::path dir = fs::temp_directory_path() / fmt::format("echoclip_transcode_{}", (long long)getpid());
+    fs::create_directories(dir / "temp", ec);
+    geode::Mod::get()->save_dir = dir;
+
+    // gop of one second like the recorder, 20s at 60fps so it splits into several pieces on any machine
+    int const fps = 60;
+    double const dur_s = 20.0;
+    fs::path src = dir / "src.mkv";
+    fs::path dst = dir / "out.mp4";
+    ProcOptions gen_opts;
+    gen_opts.timeout_s = 120.0;
+    ProcOutcome gen = run_child(fmt::format("{} -y -v error -f lavfi -i testsrc=size=320x240:rate={} -t {} -c:v libx264 -preset ultrafast -g {} -pix_fmt yuv420p \"{}\"",
+        ff_bin, fps, dur_s, fps, src.string()), gen_opts);
+    if (!gen.ok()) {
+        std::printf("couldnt make the source clip (exit %d), ffmpeg without libx264 or lavfi?\n", gen.code);
+        fs::remove_all(dir, ec);
+        return 77;
+    }
+
+    ProcOptions opts;
+    opts.timeout_s = 300.0;
+    // 3 workers whatever the machine has, so the pieces really run side by side (pipes of parallel children included)
+    // lossless, so every decoded frame has to hash the same as the source one
+    bool ok = transcode_chunked(ff_bin, src, dst, dur_s, "libx264", "-preset ultrafast -qp 0 -pix_fmt yuv420p", "", opts, 3);
+
+    int fails = 0;
+    if (!ok) { std::puts("transcode_chunked failed"); fails++; }
+    Frames in = decode_frames(ff_bin, src);
+    Frames got = decode_frames(ff_bin, dst);
+    std::printf("source %d frames, output %d frames\n", in.n, got.n);
+    if (in.n != (int)(dur_s * fps)) { std::printf("source has %d frames, expected %d\n", in.n, (int)(dur_s * fps)); fails++; }
+    if (got.n != in.n) { std::printf("frame count changed: %d -> %d\n", in.n, got.n); fails++; }
+    if (!got.continuous) { std::printf("output pts jumps at frame %lld\n", got.first_bad); fails++; }
+    // identical frames in the same order, a piece joined twice or out of order keeps the count but not this
+    if (got.n == in.n && got.hashes != in.hashes) { std::puts("output frames dont match the source"); fails++; }
+
+    fs::remove_all(dir, ec);
+    std::printf("%d failed checks\n", fails);
+    return fails == 0 ? 0 : 1;
+}